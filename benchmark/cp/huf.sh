@@ -0,0 +1,12 @@
+#!/bin/bash
+#check args
+if [ "$1" = "c" ]; then		#compress infile
+	bin/hufzip.x -c $2 $3
+elif [ "$1" = "d" ]; then	#decompress infile
+	bin/hufzip.x -d $2 $3
+elif [ "$1" = "i" ]; then	#install compressor
+	cd ..;make hufzip.x
+	cd benchmark;cp ../hufzip.x bin/hufzip.x
+else
+	exit 1
+fi
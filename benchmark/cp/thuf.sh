@@ -0,0 +1,12 @@
+#!/bin/bash
+#check args
+if [ "$1" = "c" ]; then		#compress infile
+	bin/thufzip.x -c $2 $3
+elif [ "$1" = "d" ]; then	#decompress infile
+	bin/thufzip.x -d $2 $3
+elif [ "$1" = "i" ]; then	#install compressor
+	cd ..;make thufzip.x
+	cd benchmark;cp ../thufzip.x bin/thufzip.x
+else
+	exit 1
+fi
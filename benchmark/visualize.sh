@@ -237,7 +237,7 @@ cat <<'THEEND'
 \pgfplotstableset{
 	create on use/tunneling-potential/.style={
 		create col/expr={
-			\thisrow{tbwzip-expectedtbwtgrossbenefitsize} / \thisrow{bwzip-bwtencodingsize} * 100
+			\thisrow{tbwzip-estimatedtbwtgrossbenefitsize} / \thisrow{bwzip-bwtencodingsize} * 100
 		}
 	}
 THEEND
@@ -248,11 +248,11 @@ echo ",
 			max(0,min(
 			(1 + \thisrow{t$bwcp-auxencodingsize} / (\thisrow{$bwcp-bwtencodingsize} - \thisrow{t$bwcp-tbwtencodingsize} - \thisrow{t$bwcp-auxencodingsize}))
 			,
-			(1 + \thisrow{t$bwcp-expectedauxtaxsize} / (\thisrow{t$bwcp-expectedtbwtgrossbenefitsize} - \thisrow{t$bwcp-expectedauxtaxsize}))
+			(1 + \thisrow{t$bwcp-estimatedauxencodingsize} / (\thisrow{t$bwcp-estimatedtbwtgrossbenefitsize} - \thisrow{t$bwcp-estimatedauxencodingsize}))
 			)) / max(
 			(1 + \thisrow{t$bwcp-auxencodingsize} / (\thisrow{$bwcp-bwtencodingsize} - \thisrow{t$bwcp-tbwtencodingsize} - \thisrow{t$bwcp-auxencodingsize}))
 			,
-			(1 + \thisrow{t$bwcp-expectedauxtaxsize} / (\thisrow{t$bwcp-expectedtbwtgrossbenefitsize} - \thisrow{t$bwcp-expectedauxtaxsize}))
+			(1 + \thisrow{t$bwcp-estimatedauxencodingsize} / (\thisrow{t$bwcp-estimatedtbwtgrossbenefitsize} - \thisrow{t$bwcp-estimatedauxencodingsize}))
 			)
 			* 100
 		}
@@ -0,0 +1,220 @@
+/*
+ * aux-coder.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _AUX_CODER_HPP
+#define _AUX_CODER_HPP
+
+#include "aux-encoding.hpp"
+#include "twobitvector.hpp"
+
+#include <stdexcept>
+#include <stdint.h>
+
+//! class which encodes a (run-based) auxiliary structure using an adaptive binary range coder.
+/*! the structure is mostly made of REG entries, so it is coded as a sequence of
+  pairs (length of REG-run, following non-REG entry). Run lengths are Elias-gamma coded,
+  and all binary decisions use small adaptive contexts depending on the previous
+  non-REG entry. REG-runs are skipped word-wise, so the coding time depends on the
+  number of non-REG entries rather than on the length of the structure.
+  The length of the structure is not stored and must be known by the decoder.
+ */
+class aux_coder {
+	private:
+		typedef uint16_t prob_t;
+		typedef twobitvector::size_type size_type;
+
+		static const unsigned PROB_BITS = 12;
+		static const unsigned MOVE_BITS = 4;
+		static const uint32_t TOP = 1u << 24;
+		//maximal number of bits of a run length
+		static const unsigned MAX_LEN_BITS = 48;
+
+		//adaptive probabilities, all contexts depend on the previous non-REG entry
+		struct model {
+			prob_t exp[4][MAX_LEN_BITS+1];          //unary coded exponent of run length + 1
+			prob_t mant[4][MAX_LEN_BITS][2];        //mantissa bits, by exponent and top bit
+			prob_t hi[4];                           //higher bit of entry
+			prob_t lo[4];                           //lower bit of entry (if higher bit is set)
+
+			model() {
+				prob_t *p = &exp[0][0];
+				for (size_t i = 0; i < sizeof(model) / sizeof(prob_t); i++)	p[i] = 1u << (PROB_BITS - 1);
+			};
+		};
+
+		//binary range encoder (carry propagation as in LZMA)
+		template<class ostream_t>
+		class encoder {
+			private:
+				ostream_t &out;
+				uint64_t low = 0;
+				uint32_t range = 0xFFFFFFFFu;
+				uint8_t cache = 0;
+				uint64_t cache_size = 1;
+
+				void shift_low() {
+					if ((uint32_t)low < 0xFF000000u || (low >> 32) != 0) {
+						uint8_t carry = (uint8_t)(low >> 32);
+						uint8_t temp = cache;
+						do {
+							out.put( (char)(uint8_t)(temp + carry) );
+							temp = 0xFF;
+						} while (--cache_size != 0);
+						cache = (uint8_t)(low >> 24);
+					}
+					cache_size++;
+					low = (low & 0x00FFFFFFu) << 8;
+				};
+			public:
+				encoder( ostream_t &s ) : out( s ) {};
+
+				void encode( prob_t &p, unsigned bit ) {
+					uint32_t bound = (range >> PROB_BITS) * p;
+					if (bit == 0) {
+						range = bound;
+						p += ((1u << PROB_BITS) - p) >> MOVE_BITS;
+					} else {
+						low += bound;
+						range -= bound;
+						p -= p >> MOVE_BITS;
+					}
+					while (range < TOP) {
+						range <<= 8;
+						shift_low();
+					}
+				};
+
+				void flush() {
+					for (unsigned i = 0; i < 5; i++)	shift_low();
+				};
+		};
+
+		//binary range decoder
+		template<class istream_t>
+		class decoder {
+			private:
+				istream_t &in;
+				uint32_t range = 0xFFFFFFFFu;
+				uint32_t code = 0;
+			public:
+				decoder( istream_t &s ) : in( s ) {
+					for (unsigned i = 0; i < 5; i++)	code = (code << 8) | (uint8_t)in.get();
+				};
+
+				unsigned decode( prob_t &p ) {
+					uint32_t bound = (range >> PROB_BITS) * p;
+					unsigned bit;
+					if (code < bound) {
+						range = bound;
+						p += ((1u << PROB_BITS) - p) >> MOVE_BITS;
+						bit = 0;
+					} else {
+						code -= bound;
+						range -= bound;
+						p -= p >> MOVE_BITS;
+						bit = 1;
+					}
+					while (range < TOP) {
+						range <<= 8;
+						code = (code << 8) | (uint8_t)in.get();
+					}
+					return bit;
+				};
+		};
+
+		//codes the run length r (Elias-gamma of r+1)
+		template<class ostream_t>
+		static void encode_run( encoder<ostream_t> &enc, model &m, unsigned ctx, uint64_t r ) {
+			uint64_t x = r + 1;
+			unsigned k = 63 - __builtin_clzll( x );
+			for (unsigned i = 0; i < k; i++)	enc.encode( m.exp[ctx][i], 1 );
+			enc.encode( m.exp[ctx][k], 0 );
+			unsigned top = 0;
+			for (unsigned i = k; i-- > 0; ) {
+				unsigned bit = (x >> i) & 1u;
+				enc.encode( m.mant[ctx][i][top], bit );
+				if (i + 1 == k)	top = bit;
+			}
+		};
+
+		template<class istream_t>
+		static uint64_t decode_run( decoder<istream_t> &dec, model &m, unsigned ctx ) {
+			unsigned k = 0;
+			while (dec.decode( m.exp[ctx][k] )) {
+				if (++k > MAX_LEN_BITS - 1)	throw std::invalid_argument("invalid aux encoding");
+			}
+			uint64_t x = 1;
+			unsigned top = 0;
+			for (unsigned i = k; i-- > 0; ) {
+				unsigned bit = dec.decode( m.mant[ctx][i][top] );
+				x = (x << 1) | bit;
+				if (i + 1 == k)	top = bit;
+			}
+			return x - 1;
+		};
+	public:
+		//! encodes aux to out.
+		template<class ostream_t>
+		static void encode( const twobitvector &aux, ostream_t &out ) {
+			using namespace aux_encoding;
+			encoder<ostream_t> enc( out );
+			model m;
+			unsigned ctx = REG;
+			size_type n = aux.size();
+			for (size_type i = 0; ; ) {
+				size_type j = aux.find_not( REG, i ); //skip REG-run
+				encode_run( enc, m, ctx, j - i );
+				if (j == n)	break;
+				value_type v = aux[j];
+				enc.encode( m.hi[ctx], v >> 1 );
+				if (v >> 1)	enc.encode( m.lo[ctx], v & 1u );
+				ctx = v;
+				i = j + 1;
+			}
+			enc.flush();
+		};
+
+		//! decodes aux from in (aux must have the length of the encoded structure).
+		/*! throws an invalid_argument if the encoding is invalid.
+		 */
+		template<class istream_t>
+		static void decode( istream_t &in, twobitvector &aux ) {
+			using namespace aux_encoding;
+			decoder<istream_t> dec( in );
+			model m;
+			unsigned ctx = REG;
+			size_type n = aux.size();
+			for (size_type i = 0; ; ) {
+				uint64_t r = decode_run( dec, m, ctx );
+				if (r > n - i)	throw std::invalid_argument("invalid aux encoding");
+				aux.fill( i, i + r, REG );
+				i += r;
+				if (i == n)	break;
+				value_type v = dec.decode( m.hi[ctx] ) ? IGN_L | dec.decode( m.lo[ctx] ) : SKP_F;
+				aux[i++] = v;
+				ctx = v;
+			}
+		};
+};
+
+#endif
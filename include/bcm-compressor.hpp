@@ -39,6 +39,9 @@
 class BW_SS_BCM : public block_scores_rle_model {
 	
 public:
+	//! id of this second stage in the format tag of encodings (see block_compressor::format_id)
+	static const uint32_t FORMAT_ID = 2;
+
 	//! encodes the transform t using MTF + RLE0 + Entropy
 	template<class T>
 	static void encode( T &t, std::ostream &out ) {
@@ -24,17 +24,36 @@
 #ifndef _BLOCK_COMPRESSOR_HPP
 #define _BLOCK_COMPRESSOR_HPP
 
+#include "bounded-queue.hpp"
+#include "crc32c.hpp"
+#include "huge-page-allocator.hpp"
+#include "long-range-dedup.hpp"
+#include "metrics-sink.hpp"
+#include "perf-counters.hpp"
+#include "span-streambuf.hpp"
+
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include <forward_list>
 #include <ios>
 #include <iostream>
 #include <istream>
 #include <iterator>
 #include <limits>
+#include <list>
+#include <math.h>
+#include <memory>
+#include <mutex>
 #include <ostream>
 #include <sstream>
 #include <stdexcept>
+#include <stdint.h>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 //! abstract base class for a block compressor.
 /*! a block compressor divides its input into blocks
@@ -42,27 +61,739 @@
    each block individually.
  */
 class block_compressor {
+	public:
+		//! type of texts and transformed texts of blocks
+		typedef std::vector<unsigned char, huge_page_allocator<unsigned char>> text_t;
+
+		class compression_context;
+
+	protected:
+		//! state of a block passed between the stages of compression.
+		/*! compressors may derive from this class to store intermediate results.
+		*/
+		struct block_state {
+			text_t data; //text of the block
+			compression_context *ctx = nullptr; //context the state was taken from (if any), see scratch_memory
+			std::streampos pos = 0; //position of the block in the input
+			int64_t index = -1; //index of the block in the input (-1 if unknown)
+			std::streamsize size = 0; //length of the block
+			bool stored = false; //whether the block is stored without compression
+			std::string dedup; //side stream of long repeats removed from data (empty if none)
+			uint32_t crc = 0; //checksum of the text of the block (if checksums are enabled)
+			virtual ~block_state() {};
+		};
+
+		//entry of the header of an encoding
+		struct block_info {
+			std::streampos start; //start position of the encoded block
+			std::streampos end; //end position of the encoded block
+			uint64_t size; //length of the decoded block
+		};
+
+	public:
+		//! reusable memory of compressions (see compress).
+		/*! a context keeps the block states of finished compressions, i.e. the memory of
+		   block texts and intermediate results, as well as the scratch memory of stages
+		   (e.g. suffix arrays and encoding buffers), such that following compressions do
+		   not allocate them again. A context may be shared by many threads, concurrent
+		   compressions use different states and scratch memory. States are kept for the
+		   compressor of the last compression only.
+		 */
+		class compression_context {
+			friend class block_compressor;
+			private:
+				std::mutex m;
+				const block_compressor *owner = nullptr; //compressor the kept states belong to
+				std::vector<std::unique_ptr<block_state>> states;
+				std::vector<text_t> scratch; //scratch memory not in use
+
+				//takes a kept state of compressor c, or creates a new one
+				std::unique_ptr<block_state> take( const block_compressor &c ) {
+					std::unique_ptr<block_state> bs;
+					{
+						std::lock_guard<std::mutex> lock( m );
+						if (owner == &c && !states.empty()) {
+							bs = std::move( states.back() );
+							states.pop_back();
+						}
+					}
+					if (!bs)	bs = c.make_block_state();
+					bs->ctx = this;
+					return bs;
+				};
+
+				//takes kept scratch memory, or returns an empty one
+				text_t take_scratch() {
+					std::lock_guard<std::mutex> lock( m );
+					text_t t;
+					if (!scratch.empty()) {
+						t.swap( scratch.back() );
+						scratch.pop_back();
+					}
+					return t;
+				};
+
+				//keeps scratch memory for following stages
+				void keep_scratch( text_t &&t ) {
+					std::lock_guard<std::mutex> lock( m );
+					scratch.push_back( std::move( t ) );
+				};
+
+				//keeps a state of compressor c for following compressions
+				void keep( const block_compressor &c, std::unique_ptr<block_state> bs ) {
+					std::lock_guard<std::mutex> lock( m );
+					if (owner != &c) {
+						states.clear();
+						owner = &c;
+					}
+					states.push_back( std::move( bs ) );
+				};
+			public:
+				//! releases all kept states and scratch memory.
+				void clear() {
+					std::lock_guard<std::mutex> lock( m );
+					states.clear();
+					scratch.clear();
+					owner = nullptr;
+				};
+		};
+
+		//! cache of recently decompressed blocks of one compressed input (see decompress_range).
+		/*! keeps the header of the input and the most recently used blocks up to a capacity
+		   in bytes, larger blocks are not cached. A cache may be shared by many threads,
+		   each reading the input with its own stream, but must not be used for different inputs.
+		 */
+		class block_cache {
+			friend class block_compressor;
+			private:
+				std::mutex m;
+				size_t capacity;
+				size_t used = 0; //size of cached blocks
+				std::shared_ptr<const std::vector<block_info>> blocks; //header of the input
+				std::list<std::pair<uint64_t, std::shared_ptr<const std::string>>> lru; //most recently used first
+
+				//returns the header of the input, which is read from in by c first if necessary.
+				// The header is shared, so it stays valid even if the cache is cleared meanwhile
+				std::shared_ptr<const std::vector<block_info>> header( const block_compressor &c, std::istream &in ) {
+					std::lock_guard<std::mutex> lock( m );
+					if (!blocks) {
+						in.seekg( 0 );
+						blocks = std::make_shared<const std::vector<block_info>>( c.read_header( in ) );
+					}
+					return blocks;
+				};
+
+				//returns block i, or an empty pointer if it is not cached
+				std::shared_ptr<const std::string> get( uint64_t i ) {
+					std::lock_guard<std::mutex> lock( m );
+					for (auto it = lru.begin(); it != lru.end(); ++it) {
+						if (it->first == i) {
+							lru.splice( lru.begin(), lru, it );
+							return it->second;
+						}
+					}
+					return nullptr;
+				};
+
+				//caches block i, and drops least recently used blocks exceeding the capacity
+				void put( uint64_t i, std::shared_ptr<const std::string> b ) {
+					std::lock_guard<std::mutex> lock( m );
+					if (b->size() > capacity)	return;
+					for (auto &e : lru) {
+						if (e.first == i)	return; //cached by another thread meanwhile
+					}
+					lru.emplace_front( i, b );
+					for (used += b->size(); used > capacity; lru.pop_back()) {
+						used -= lru.back().second->size();
+					}
+				};
+			public:
+				//! constructor, expects the maximal size of cached blocks in bytes (default 256M).
+				block_cache( size_t cap = (size_t)256 << 20 ) : capacity( cap ) {};
+
+				//! removes all cached blocks and the header.
+				void clear() {
+					std::lock_guard<std::mutex> lock( m );
+					lru.clear();
+					used = 0;
+					blocks.reset();
+				};
+		};
+
 	private:
 		//current block size (it is ensured that block size is smaller than maxblocksize)
 		std::streamsize blocksize;
 		// constant indicating how big a block can maximally be
 		const std::streamsize maxblocksize;
-		bool quiet = true; //indicates whether compressor is quiet and does not print any additional information
+		bool quiet = true; //indicates whether compressor is quiet and does not print metrics to std::cout
+		unsigned threads = 1; //number of threads a compressor may use for a single block
+		bool dedup = false; //indicates whether long repeats are removed before transformation
+		bool checksums = false; //indicates whether a checksum of the text of each block is stored
+		bool perf = false; //indicates whether hardware counters of stages are recorded
+		size_t memory_budget = 0; //memory the transformation of a block may use (0 means unlimited)
+		std::string scratch_dir = "/tmp"; //directory for temporary files of the transformation
+		std::shared_ptr<metrics_sink> sink; //receiver of metrics (none if empty)
+		mutable std::mutex in_mutex; //serializes access to the input of concurrent pipeline stages
+
+		//maximal number of blocks in the compression pipeline at the same time
+		static const size_t BLOCKS_IN_FLIGHT = 3;
+
+		//modes of a block, stored in front of each block
+		static const char BLOCK_ENCODED = 0; //block is encoded by the compressor
+		static const char BLOCK_STORED  = 1; //block is stored without compression
+		static const char BLOCK_DEDUP   = 2; //long repeats of the block are removed, followed by an encoding
+		static const int BLOCK_CHECKSUM = 0x80; //flag of a mode followed by the checksum of the text
+
+		//tag in front of each encoding, identifying the container format, its version and
+		// the compressor (see format_id)
+		static const uint32_t FORMAT_MAGIC   = 0x5a574254; //"TBWZ"
+		static const uint32_t FORMAT_VERSION = 2;
+		static const std::streamoff FORMAT_TAG_SIZE = 3 * sizeof(uint32_t);
+
+		//blocks with higher estimated entropies (in bits per byte) are stored without compression
+		static constexpr double INCOMPRESSIBLE_H0 = 7.9;
+		static constexpr double INCOMPRESSIBLE_H1 = 7.5;
+
+		//block and stage of the current thread, attached to all recorded metrics
+		struct metrics_context {
+			int64_t block = -1;
+			const char *stage = "";
+		};
+		static metrics_context &context() {
+			static thread_local metrics_context c;
+			return c;
+		};
+
+		//sets the block and stage of the current thread during its lifetime (a negative block
+		// keeps the current one). If a stage is given, its duration and peak memory of big
+		// arrays (allocated by this thread and threads started by stage_thread, see
+		// memory_policy::peak_tracker) as well as hardware counters (see set_perf_counters)
+		// are recorded at the end of the stage.
+		class stage_scope {
+			private:
+				const block_compressor &c;
+				const metrics_context prev;
+				const bool measured; //whether duration and peak memory are recorded
+				memory_policy::peak_tracker tracker;
+				memory_policy::peak_tracker *const prev_tracker;
+				std::unique_ptr<perf_counters> counters;
+				std::chrono::high_resolution_clock::time_point start;
+			public:
+				stage_scope( const block_compressor &comp, int64_t block, const char *stage = "" )
+				           : c( comp ), prev( context() ), measured( *stage != '\0' && comp.active_sink() != nullptr ),
+				             prev_tracker( measured ? memory_policy::adopt( &tracker ) : memory_policy::tracker() ) {
+					if (block >= 0)	context().block = block;
+					if (*stage != '\0')	context().stage = stage;
+					if (measured)	counters = c.start_counters();
+					start = std::chrono::high_resolution_clock::now();
+				};
+				~stage_scope() {
+					try {
+						if (measured) {
+							auto stop = std::chrono::high_resolution_clock::now();
+							std::string stage( context().stage );
+							c.record_counters( stage, counters );
+							c.record_duration( stage + " time", stop - start );
+							c.record( metric_record::MEMORY, stage + " peak memory", tracker.peak() );
+						}
+					} catch (...) {} //metrics are not worth an exception
+					memory_policy::adopt( prev_tracker );
+					context() = prev;
+				};
+		};
+
+		//returns the sink receiving metrics, or nullptr if metrics are not recorded
+		metrics_sink *active_sink() const {
+			static text_metrics_sink stdout_sink( std::cout );
+			return sink ? sink.get() : (quiet ? nullptr : &stdout_sink);
+		};
+
+		//records a metric of the current block and stage
+		void record( metric_record::type_t type, const std::string &key, int64_t value,
+		             const std::string &text = "" ) const {
+			metrics_sink *s = active_sink();
+			if (s != nullptr) {
+				s->record( metric_record{ context().block, context().stage, key, type, value, text } );
+			}
+		};
+
+		//estimates whether a text is incompressible using order-0 and order-1 entropies
+		// on samples of the text. Texts which are too short for sampling are never
+		// classified as incompressible.
+		static bool is_incompressible( const unsigned char *s, size_t n ) {
+			const size_t SAMPLES = 16, SAMPLE_LENGTH = 4096;
+			if (n < SAMPLES * SAMPLE_LENGTH)	return false;
+			std::vector<uint32_t> c0( 256 ), c1( 256 * 256 );
+			for (size_t k = 0; k < SAMPLES; k++) {
+				const unsigned char *p = s + k * (n - SAMPLE_LENGTH) / (SAMPLES - 1);
+				++c0[p[0]];
+				for (size_t i = 1; i < SAMPLE_LENGTH; i++) {
+					++c0[p[i]];
+					++c1[p[i-1] * 256 + p[i]];
+				}
+			}
+			//returns the empirical entropy of c[0..255] in bits (using Miller-Madow bias correction),
+			// and adds the number of counted characters to m
+			auto bits = []( const uint32_t *c, double &m ) {
+				double cm = 0, clogc = 0, k = 0;
+				for (size_t i = 0; i < 256; i++) {
+					if (c[i] == 0)	continue;
+					cm += c[i];
+					clogc += c[i] * log2( (double)c[i] );
+					k++;
+				}
+				m += cm;
+				return (cm == 0) ? 0.0 : cm * log2( cm ) - clogc + (k - 1) / (2 * log( 2.0 ));
+			};
+			double m0 = 0, m1 = 0, h1 = 0;
+			double h0 = bits( c0.data(), m0 ) / m0;
+			if (h0 < INCOMPRESSIBLE_H0)	return false;
+			for (size_t i = 0; i < 256; i++) {
+				h1 += bits( c1.data() + i * 256, m1 );
+			}
+			return h1 / m1 >= INCOMPRESSIBLE_H1;
+		};
+
+		//runs the transformation stage of a block, unless the block is incompressible.
+		// If deduplication is enabled, long repeats are removed before.
+		void transform_or_skip( block_state &bs ) const {
+			stage_scope scope( *this, bs.index, "transform" );
+			if (checksums) {
+				bs.crc = crc32c::update( 0, bs.data.data(), bs.data.size() );
+			}
+			bs.dedup.clear();
+			bs.stored = is_incompressible( bs.data.data(), bs.data.size() );
+			if (bs.stored) {
+				print_info("block mode", "stored (high entropy)");
+				return;
+			}
+			if (dedup) {
+				bs.dedup = long_range_dedup::reduce( bs.data );
+				record_bytes("dedup removed", bs.size - (std::streamsize)bs.data.size() );
+				record_bytes("dedup side stream", bs.dedup.size() );
+			}
+			transform_block( bs );
+		};
+
+		//writes the mode of a block to out, followed by the checksum of its text if checksums
+		// are enabled. Returns the number of written bytes
+		size_t write_mode( char mode, const block_state &bs, std::ostream &out ) const {
+			if (!checksums) {
+				out.put( mode );
+				return 1;
+			}
+			out.put( (char)(mode | BLOCK_CHECKSUM) );
+			write_primitive<uint32_t>( bs.crc, out );
+			return 1 + sizeof(uint32_t);
+		};
+
+		//runs the encoding stage of a block and writes the block to out, or stores
+		// the block if this is smaller. The encoding is buffered in scratch memory to decide
+		// this (so it is written once more), the original text is reread from in if necessary.
+		void encode_or_store( std::istream &in, block_state &bs, std::ostream &out ) const {
+			stage_scope scope( *this, bs.index, "encode" );
+			record_bytes("block size", bs.size );
+			if (!bs.stored) {
+				scratch_memory buf( bs );
+				vector_ostreambuf<text_t> eb( buf.vector() );
+				std::ostream enc( &eb );
+				enc.exceptions( std::ostream::badbit );
+				encode_block( bs, enc );
+				const std::streamsize e = eb.size();
+				if (!bs.dedup.empty() && (std::streamsize)(sizeof(uint64_t) + bs.dedup.size()) + e < bs.size) {
+					print_info("block mode", "deduplicated");
+					auto m = write_mode( BLOCK_DEDUP, bs, out );
+					write_primitive<uint64_t>( bs.dedup.size(), out );
+					out.write( bs.dedup.data(), bs.dedup.size() );
+					out.write( eb.data(), e );
+					record_bytes("block encoding size", m + sizeof(uint64_t) + bs.dedup.size() + e );
+					return;
+				}
+				if (bs.dedup.empty() && e < bs.size) {
+					print_info("block mode", "encoded");
+					auto m = write_mode( BLOCK_ENCODED, bs, out );
+					out.write( eb.data(), e );
+					record_bytes("block encoding size", m + e );
+					return;
+				}
+				print_info("block mode", "stored (encoding not smaller)");
+
+				//reread text, as it was changed by the transformation
+				std::lock_guard<std::mutex> lock( in_mutex );
+				auto p = in.tellg();
+				in.seekg( bs.pos );
+				read_block( in, bs.pos + bs.size, bs );
+				in.seekg( p );
+			}
+			auto m = write_mode( BLOCK_STORED, bs, out );
+			out.write( (const char *)bs.data.data(), bs.size );
+			record_bytes("block encoding size", m + bs.size );
+		};
+
+		//writes the format tag of an encoding of this compressor to out
+		void write_format( std::ostream &out ) const {
+			write_primitive<uint32_t>( FORMAT_MAGIC, out );
+			write_primitive<uint32_t>( FORMAT_VERSION, out );
+			write_primitive<uint32_t>( format_id(), out );
+		};
+
+		//reads the format tag of an encoding from in, and throws an invalid argument exception
+		// if in is not an encoding of this format (e.g. of an older version) and this compressor
+		void read_format( std::istream &in ) const {
+			if (read_primitive<uint32_t>( in ) != FORMAT_MAGIC)
+				throw std::invalid_argument("unknown format, input is not compressed or of an older version");
+			auto v = read_primitive<uint32_t>( in );
+			if (v != FORMAT_VERSION)
+				throw std::invalid_argument("unsupported format version " + std::to_string( v ));
+			if (read_primitive<uint32_t>( in ) != format_id())
+				throw std::invalid_argument("input was compressed by another compressor");
+		};
+
+		//reads the format tag and header of an encoding and returns the positions and decoded
+		// sizes of its blocks. The header is a chain of segments (see append), each followed
+		// by its blocks
+		std::vector<block_info> read_header( std::istream &in ) const {
+			std::vector<block_info> blocks;
+			read_format( in );
+			while (true) {
+				std::streampos headerend = read_primitive<std::streamoff>( in ), prev = headerend;
+				std::streamoff next = read_primitive<std::streamoff>( in );
+				while (in.tellg() < headerend) {
+					auto p = read_primitive<std::streamoff>( in );
+					auto s = read_primitive<uint64_t>( in );
+					if (p < prev)
+						throw std::invalid_argument("invalid header end positions");
+					if (s > (uint64_t)get_max_block_size())
+						throw std::invalid_argument("invalid header block size");
+
+					blocks.push_back( block_info{ prev, p, s } );
+					prev = p;
+				}
+				if (in.tellg() != headerend)
+					throw std::invalid_argument("invalid header end positions");
+				if (next == 0)	break;
+				if (next < prev) //segments follow the blocks of their predecessor
+					throw std::invalid_argument("invalid header segment link");
+				in.seekg( next );
+			}
+			record_count("number of blocks", blocks.size() );
+			return blocks;
+		};
+
+		//writes a header segment to position start of out, i.e. the position behind the
+		// segment, an empty link to a next segment, and the end position and decoded size
+		// of each block. Moves out behind the last block afterwards
+		static void write_header( std::streampos start, const std::forward_list<std::streampos> &blockend,
+		                          const std::vector<uint64_t> &sizes, std::ostream &out ) {
+			out.seekp( start ); //jump back to start of segment
+			auto it = blockend.begin();
+			std::streamoff n = *it;
+			write_primitive<std::streamoff>( n, out );
+			write_primitive<std::streamoff>( 0, out );
+			for (size_t i = 0; ++it != blockend.end(); i++) {
+				n = *it;
+				write_primitive<std::streamoff>( n, out ); //end positions
+				write_primitive<uint64_t>( sizes[i], out );
+			}
+			out.seekp( n );
+			out.flush();
+		};
+
+		//copies a stored block, which ends at position end of in, to out
+		void copy_stored( std::istream &in, std::streampos end, std::ostream &out ) const {
+			if (end - in.tellg() > get_max_block_size())
+				throw std::invalid_argument("stored block is too long");
+			std::vector<char> buf( std::min( end - in.tellg(), (std::streamoff)1 << 20 ) );
+			for (auto r = end - in.tellg(); r > 0; r -= buf.size()) {
+				buf.resize( std::min( r, (std::streamoff)buf.size() ) );
+				in.read( buf.data(), buf.size() );
+				out.write( buf.data(), buf.size() );
+			}
+		};
+
+		//reads the side stream of a deduplicated block, which ends at position end of in
+		static std::string read_dedup( std::istream &in, std::streampos end ) {
+			auto m = read_primitive<uint64_t>( in );
+			if (m == 0 || m > (uint64_t)(end - in.tellg()))
+				throw std::invalid_argument("invalid deduplication stream length");
+			std::string side( m, '\0' );
+			in.read( &side[0], m );
+			return side;
+		};
+
+		//decodes a block (including its mode), which ends at position end of in, to out.
+		// If the block has a checksum, it is computed on the decoded text passed to out
+		void decode_or_copy( std::istream &in, std::streampos end, std::ostream &out ) const {
+			auto mode = in.get();
+			if (mode != EOF && (mode & BLOCK_CHECKSUM)) {
+				auto crc = read_primitive<uint32_t>( in );
+				crc32c_ostreambuf cb( out.rdbuf() );
+				std::ostream checked( &cb );
+				checked.exceptions( std::ostream::badbit );
+				decode_mode( in, mode & ~BLOCK_CHECKSUM, end, checked );
+				checked.flush();
+				if (cb.checksum() != crc) {
+					throw std::invalid_argument("block checksum mismatch");
+				}
+			} else {
+				decode_mode( in, mode, end, out );
+			}
+			if (in.tellg() != end) {
+				throw std::invalid_argument("invalid block decompression");
+			}
+		};
+
+		//decodes a block of the given mode, which ends at position end of in, to out
+		void decode_mode( std::istream &in, int mode, std::streampos end, std::ostream &out ) const {
+			if (mode == BLOCK_STORED) {
+				copy_stored( in, end, out );
+			} else if (mode == BLOCK_ENCODED) {
+				decompress_block( in, end, out );
+			} else if (mode == BLOCK_DEDUP) {
+				//decode reduced text and restore removed repeats
+				std::string side = read_dedup( in, end );
+				std::ostringstream reduced;
+				reduced.exceptions( std::ostream::badbit );
+				decompress_block( in, end, reduced );
+				std::vector<char> buf;
+				long_range_dedup::expand( reduced.str(), side, get_max_block_size(), buf );
+				out.write( buf.data(), buf.size() );
+			} else {
+				throw std::invalid_argument("invalid block mode");
+			}
+		};
+
+		//compresses blocks using a pipeline of the stages read, transform and encode,
+		// each running in its own thread. End positions of the encoded blocks are inserted
+		// into blockend behind it. Block states are taken from ctx, if given.
+		void compress_pipelined( std::istream &in, std::streamsize n, std::ostream &out,
+		                         std::forward_list<std::streampos>::iterator it,
+		                         std::forward_list<std::streampos> &blockend,
+		                         compression_context *ctx ) const {
+			typedef std::unique_ptr<block_state> state_ptr;
+			bounded_queue<state_ptr> pool( BLOCKS_IN_FLIGHT ); //unused block states
+			bounded_queue<state_ptr> read( BLOCKS_IN_FLIGHT ); //blocks read from input
+			bounded_queue<state_ptr> transformed( BLOCKS_IN_FLIGHT ); //transformed blocks
+			for (size_t i = 0; i < BLOCKS_IN_FLIGHT; i++) {
+				pool.push( ctx != nullptr ? ctx->take( *this ) : make_block_state() );
+			}
+
+			//on errors, store the first exception and stop all stages
+			std::exception_ptr err;
+			std::mutex err_mutex;
+			auto fail = [&]() {
+				{
+					std::lock_guard<std::mutex> lock( err_mutex );
+					if (!err)	err = std::current_exception();
+				}
+				pool.close( true ); read.close( true ); transformed.close( true );
+			};
+
+			std::thread reader( [&]() {
+				try {
+					state_ptr bs;
+					int64_t index = 0;
+					for (auto r = n; r > 0 && pool.pop( bs ); ) {
+						auto bsize = std::min(r, get_block_size());
+						{
+							std::lock_guard<std::mutex> lock( in_mutex );
+							read_block( in, in.tellg()+bsize, *bs );
+						}
+						bs->index = index++;
+						r -= bsize;
+						if (!read.push( std::move( bs ) ))	break;
+					}
+					read.close();
+				} catch (...) {
+					fail();
+				}
+			} );
+			std::thread transformer( [&]() {
+				try {
+					state_ptr bs;
+					while (read.pop( bs )) {
+						transform_or_skip( *bs );
+						if (!transformed.push( std::move( bs ) ))	break;
+					}
+					transformed.close();
+				} catch (...) {
+					fail();
+				}
+			} );
+
+			try {
+				state_ptr bs;
+				while (transformed.pop( bs )) {
+					encode_or_store( in, *bs, out );
+					it = blockend.insert_after( it, out.tellp() );
+					if (!pool.push( std::move( bs ) ))	break;
+				}
+			} catch (...) {
+				fail();
+			}
+			reader.join();
+			transformer.join();
+			if (err)	std::rethrow_exception( err );
+
+			//return states to the context
+			pool.close();
+			for (state_ptr bs; ctx != nullptr && pool.pop( bs ); ) {
+				ctx->keep( *this, std::move( bs ) );
+			}
+		};
 	protected:
 		//prototypes for real encoding and decoding. end refers to the end position
 		// in the input stream at which the input ends. For compress - function, this
 		// class ensures that input to be compressed is smaller or equal to maxblocksize,
 		// decompress function may check itself if output is smaller than maxblocksize.
-		virtual void compress_block( std::istream &in, std::streampos end, std::ostream &out ) const = 0;
+		// The default compress_block runs the stages read_block, transform_block and encode_block,
+		// and stores the block without compression if it is incompressible.
+		virtual void compress_block( std::istream &in, std::streampos end, std::ostream &out ) const {
+			auto bs = make_block_state();
+			read_block( in, end, *bs );
+			transform_or_skip( *bs );
+			encode_or_store( in, *bs, out );
+		};
 		virtual void decompress_block( std::istream &in, std::streampos end, std::ostream &out ) const = 0;
 
-		//a function to print information during encoding (function will not print
-		// something if compressor is set to be quiet, what is the default)
-		template<class V>
-		void print_info( std::string key, V value ) const {
-			if (!quiet) {
-				std::cout << "> " << key << "\t\t" << value << std::endl;
+		//prototypes for the stages of block compression. make_block_state creates an empty state,
+		// transform_block does a first transformation of the read block, and encode_block writes
+		// the encoding of the transformed block to out. If multiple threads are allowed, blocks
+		// pass these stages in a pipeline, so different blocks may be in different stages at once.
+		virtual std::unique_ptr<block_state> make_block_state() const = 0;
+		virtual void transform_block( block_state &bs ) const = 0;
+		virtual void encode_block( block_state &bs, std::ostream &out ) const = 0;
+
+		//rewrites the encoding of a block (without mode) of compressor from, which ends at
+		// position end of in, as encoding of this compressor. The default decompresses
+		// the block and compresses it again; compressors sharing the transformation of from
+		// should override this to only recode the transformed text (see decode_transformed).
+		virtual void transcode_block( std::istream &in, std::streampos end, std::ostream &out,
+		                              const block_compressor &from ) const {
+			std::ostringstream dec;
+			dec.exceptions( std::ostream::badbit );
+			from.decompress_block( in, end, dec );
+			std::istringstream tin( dec.str() );
+			tin.exceptions( std::istream::badbit | std::istream::eofbit );
+			auto bs = make_block_state();
+			read_block( tin, dec.str().size(), *bs );
+			transform_block( *bs );
+			encode_block( *bs, out );
+		};
+
+		//run the stages of another compressor c, such that compressors may delegate blocks to others
+		static void delegate_compress_block( const block_compressor &c, std::istream &in, std::streampos end, std::ostream &out ) {
+			c.compress_block( in, end, out );
+		};
+		static void delegate_decompress_block( const block_compressor &c, std::istream &in, std::streampos end, std::ostream &out ) {
+			c.decompress_block( in, end, out );
+		};
+		static std::unique_ptr<block_state> delegate_make_block_state( const block_compressor &c ) {
+			return c.make_block_state();
+		};
+		static void delegate_transform_block( const block_compressor &c, block_state &bs ) {
+			c.transform_block( bs );
+		};
+		static void delegate_encode_block( const block_compressor &c, block_state &bs, std::ostream &out ) {
+			c.encode_block( bs, out );
+		};
+
+		//reads the input until position end into the state of a block
+		static void read_block( std::istream &in, std::streampos end, block_state &bs ) {
+			bs.pos = in.tellg();
+			bs.size = (std::streamsize)(end - bs.pos);
+			bs.data.resize( bs.size );
+			in.read( (char *)bs.data.data(), bs.size );
+		};
+
+		//functions to record metrics of the current block and stage (see set_metrics_sink),
+		// print_info records textual information. Nothing is recorded if the compressor is quiet
+		// and has no sink, what is the default
+		void print_info( const std::string &key, const std::string &text ) const {
+			record( metric_record::TEXT, key, 0, text );
+		};
+		template<class D>
+		void record_duration( const std::string &key, D d ) const {
+			record( metric_record::DURATION, key, std::chrono::duration_cast<std::chrono::nanoseconds>( d ).count() );
+		};
+		void record_bytes( const std::string &key, int64_t bytes ) const {
+			record( metric_record::BYTES, key, bytes );
+		};
+		void record_count( const std::string &key, int64_t n ) const {
+			record( metric_record::COUNT, key, n );
+		};
+
+		//starts hardware counters of the current thread for a (sub)stage, if they are enabled
+		// (see set_perf_counters) and metrics are recorded. Returns an empty pointer otherwise
+		std::unique_ptr<perf_counters> start_counters() const {
+			std::unique_ptr<perf_counters> pc;
+			if (perf && active_sink() != nullptr) {
+				pc.reset( new perf_counters() );
+				pc->start();
 			}
+			return pc;
+		};
+
+		//stops counters started by start_counters and records each available counter
+		// as "name event". If no counter is available, this is recorded once.
+		void record_counters( const std::string &name, std::unique_ptr<perf_counters> &pc ) const {
+			if (!pc)	return;
+			pc->stop();
+			static std::atomic<bool> reported_unavailable{ false };
+			if (!pc->any_available() && !reported_unavailable.exchange( true )) {
+				print_info("perf counters", "unavailable");
+			}
+			for (int e = 0; e < perf_counters::EVENTS; e++) {
+				auto ev = (perf_counters::event_t)e;
+				if (pc->available( ev ))	record_count( name + " " + perf_counters::name( ev ), pc->value( ev ) );
+			}
+			pc.reset();
+		};
+
+		//scratch memory of a stage, which is taken from the context of a block state (if any)
+		// and given back at the end of the stage, such that following compressions sharing the
+		// context neither allocate nor fault in the memory again. Without context, the memory
+		// is allocated for the stage only. It follows the memory policy in both cases
+		class scratch_memory {
+			private:
+				compression_context *const ctx;
+				text_t buf;
+			public:
+				scratch_memory( const block_state &bs ) : ctx( bs.ctx ) {
+					if (ctx != nullptr)	buf = ctx->take_scratch();
+				};
+				~scratch_memory() {
+					if (ctx != nullptr)	ctx->keep_scratch( std::move( buf ) );
+				};
+
+				//returns an array of n elements of the trivial type T with undefined content
+				template<class T>
+				T *array( size_t n ) {
+					if (buf.size() < n * sizeof(T)) {
+						text_t().swap( buf ); //do not copy old content
+						buf.resize( n * sizeof(T) );
+					}
+					return (T *)buf.data();
+				};
+
+				//returns the memory as vector, e.g. to be written by a vector_ostreambuf
+				text_t &vector() {
+					return buf;
+				};
+		};
+
+		//starts a thread running f for the current stage, i.e. the thread records metrics
+		// to the block and stage of the current thread, and its allocations count to the peak
+		// memory of the stage. The thread must be joined before the stage ends
+		template<class F>
+		std::thread stage_thread( F f ) const {
+			const metrics_context ctx = context();
+			memory_policy::peak_tracker *t = memory_policy::tracker();
+			return std::thread( [ctx,t,f]() {
+				context() = ctx;
+				memory_policy::adopt( t );
+				f();
+			} );
 		};
 
 	public:
@@ -70,11 +801,17 @@ class block_compressor {
 		block_compressor( std::streamsize max_block_size )
 		                : blocksize( max_block_size ), maxblocksize( max_block_size ) {};
 
+		//! destructor
+		virtual ~block_compressor() {};
+
 		//! sets the quiet state of this compressor (quiet=true is default).
 		/*! if the compressor is set to quiet, it will not print any extra information,
-		   otherwise it will print extra information related to the compression method used.
+		   otherwise it will print extra information related to the compression method used
+		   to std::cout (unless a metrics sink is set, see set_metrics_sink). Like the other
+		   settings passed on to the stages of a block, this setter is virtual, such that
+		   compressors composed of other compressors forward it (see multi_compressor).
 		 */
-		void set_quiet( bool q ) {
+		virtual void set_quiet( bool q ) {
 			quiet = q;
 		};
 
@@ -83,6 +820,95 @@ class block_compressor {
 			return quiet;
 		};
 
+		//! sets the sink receiving metrics of each block and stage (none is default).
+		/*! if a sink is set, metrics are passed to the sink regardless of the quiet state.
+		   Metrics are durations, sizes, counts, peak memory of big arrays and textual
+		   information, see metric_record.
+		 */
+		virtual void set_metrics_sink( std::shared_ptr<metrics_sink> s ) {
+			sink = s;
+		};
+
+		//! returns the sink receiving metrics (see set_metrics_sink).
+		std::shared_ptr<metrics_sink> get_metrics_sink() const {
+			return sink;
+		};
+
+		//! enables or disables hardware counters of each stage (perf=false is default).
+		/*! if enabled and metrics are recorded, cycles, instructions, LLC misses, dTLB misses
+		   and branch misses of each stage are recorded (see perf_counters). Counters which
+		   are not available are skipped.
+		 */
+		virtual void set_perf_counters( bool p ) {
+			perf = p;
+		};
+
+		//! returns whether hardware counters of each stage are recorded (see set_perf_counters).
+		bool get_perf_counters() const {
+			return perf;
+		};
+
+		//! sets the number of threads the compressor may use (threads=1 is default).
+		virtual void set_threads( unsigned t ) {
+			assert( t > 0 );
+			threads = t;
+		};
+
+		//! returns the number of threads the compressor may use (see set_threads).
+		unsigned get_threads() const {
+			return threads;
+		};
+
+		//! enables or disables removal of long repeats before transformation (dedup=false is default).
+		/*! see long_range_dedup. Blocks without long repeats are compressed as usual.
+		 */
+		void set_dedup( bool d ) {
+			dedup = d;
+		};
+
+		//! returns whether long repeats are removed before transformation (see set_dedup).
+		bool get_dedup() const {
+			return dedup;
+		};
+
+		//! enables or disables storing a CRC32C checksum of the text of each block (checksums=false is default).
+		/*! checksums are computed while blocks are read and verified while blocks are decoded,
+		   an invalid argument exception is thrown on mismatch. Encodings without checksums
+		   can be decompressed regardless of this setting.
+		 */
+		void set_checksums( bool c ) {
+			checksums = c;
+		};
+
+		//! returns whether a checksum of each block is stored (see set_checksums).
+		bool get_checksums() const {
+			return checksums;
+		};
+
+		//! sets the memory (in bytes) the transformation of a block may use (0 means unlimited, default).
+		/*! if the transformation of a block would need more memory in RAM, compressors may
+		   switch to semi-external algorithms using temporary files (see set_scratch_dir).
+		   Similarly, inversions may switch to slower algorithms using less memory.
+		 */
+		virtual void set_memory_budget( size_t bytes ) {
+			memory_budget = bytes;
+		};
+
+		//! returns the memory budget of the transformation of a block (see set_memory_budget).
+		size_t get_memory_budget() const {
+			return memory_budget;
+		};
+
+		//! sets the directory for temporary files of semi-external algorithms (default /tmp).
+		virtual void set_scratch_dir( const std::string &dir ) {
+			scratch_dir = dir;
+		};
+
+		//! returns the directory for temporary files (see set_scratch_dir).
+		const std::string &get_scratch_dir() const {
+			return scratch_dir;
+		};
+
 		//! returns current block size. Block size initially is set to the maximal
 		//! possible block size.
 		std::streamsize get_block_size() const {
@@ -104,13 +930,21 @@ class block_compressor {
 		//! compresses input.
 		/*! instream and outstream should not point to the same direction.
 		  function throws a runtime error if encoding failed, or a stream exception
-		  if input or output stream streams make problems.
+		  if input or output stream streams make problems. If a context is given, memory
+		  of blocks is reused from previous compressions (see compression_context).
 		 */
-		void compress( std::istream &in, std::ostream &out ) const {
+		void compress( std::istream &in, std::ostream &out, compression_context *ctx = nullptr ) const {
 			//set exception mask of instream
 			in.exceptions( std::istream::badbit | std::istream::eofbit );
 			out.exceptions( std::ostream::badbit );
 
+			write_format( out );
+			compress_segment( in, out, ctx );
+		};
+
+	private:
+		//compresses input into a header segment and its blocks at the current position of out
+		void compress_segment( std::istream &in, std::ostream &out, compression_context *ctx ) const {
 			//get length of input
 			in.seekg(0, std::ios_base::end);
 			std::streamsize n = in.tellg();
@@ -121,31 +955,100 @@ class block_compressor {
 			if (n % get_block_size() != 0)	++b;
 			
 			std::forward_list<std::streampos> blockend;
-			for (size_t i = 0; i <= b; i++) //make place for header
+			std::vector<uint64_t> sizes;
+			for (auto r = n; r > 0; r -= sizes.back())
+				sizes.push_back( std::min(r, get_block_size()) );
+			std::streampos start = out.tellp();
+			for (size_t i = 0; i <= 2*b+1; i++) //make place for header
 				write_primitive<std::streamoff>( 0, out );
 
 			blockend.push_front( out.tellp() ); //store position behind header
-			print_info("number of blocks", b );
+			record_count("number of blocks", b );
 
-			//compress blocks
+			//compress blocks, use a pipeline if multiple blocks and threads are available
 			auto it = blockend.begin();
-			while (n > 0) {
+			if (get_threads() > 1 && b > 1) {
+				compress_pipelined( in, n, out, it, blockend, ctx );
+			}
+			else for (int64_t i = 0; n > 0; i++) {
+				stage_scope scope( *this, i );
 				auto bs = std::min(n, get_block_size());
-				compress_block( in, in.tellg()+bs, out);
+				if (ctx != nullptr) {
+					auto s = ctx->take( *this );
+					read_block( in, in.tellg()+bs, *s );
+					transform_or_skip( *s );
+					encode_or_store( in, *s, out );
+					ctx->keep( *this, std::move( s ) );
+				} else {
+					compress_block( in, in.tellg()+bs, out);
+				}
 				n -= bs;
 				it = blockend.insert_after( it, out.tellp() );
 			}
 
-			//write header
-			out.seekp(0, std::ios_base::beg); //jump back to start
-			for (it = blockend.begin(); it != blockend.end(); ++it) {
-				n = *it;
-				write_primitive<std::streamoff>( n, out ); //end positions
+			//write header, and put stream to a good state
+			write_header( start, blockend, sizes, out );
+		};
+
+	public:
+		//! appends the compression of input to the compressed input io.
+		/*! the text of input is compressed into new blocks behind the end of io, indexed by a
+		  new header segment, and the link of the last segment of io is set to it afterwards.
+		  Existing blocks are neither decoded nor moved, so appending costs time proportional
+		  to the new text (and the number of previous appends). Decompressing io yields its
+		  text followed by the text of input. An empty io is treated as a fresh encoding, i.e.
+		  input is compressed into it. Exceptions are thrown as by compress, an invalid
+		  argument exception if io is not a valid encoding.
+		 */
+		void append( std::istream &in, std::iostream &io, compression_context *ctx = nullptr ) const {
+			in.exceptions( std::istream::badbit | std::istream::eofbit );
+			io.exceptions( std::istream::badbit | std::istream::eofbit );
+			io.seekg(0, std::ios_base::end);
+			const std::streamoff size = io.tellg();
+			if (size == 0) {
+				io.seekp( 0 );
+				compress( in, io, ctx );
+				return;
 			}
-			
-			//put stream to a good state and stop
-			out.seekp( n );
-			out.flush();				
+
+			//find the last segment by following the links, each segment has two positions
+			// and two entries per block
+			const std::streamoff w = sizeof(std::streamoff);
+			if (size < FORMAT_TAG_SIZE + 2*w)
+				throw std::invalid_argument("input is too short to be an encoding");
+			io.seekg( 0 );
+			read_format( io );
+			std::streamoff last = 0, next = FORMAT_TAG_SIZE;
+			do {
+				if (next <= last || next > size - 2*w)
+					throw std::invalid_argument("invalid header segment link, input may be truncated");
+				last = next;
+				io.seekg( last );
+				std::streamoff headerend = read_primitive<std::streamoff>( io );
+				if (headerend < last + 2*w || (headerend - last) % (2*w) != 0 || headerend > size)
+					throw std::invalid_argument("invalid header end positions, input may be truncated");
+				next = read_primitive<std::streamoff>( io );
+				if (next == 0) { //blocks of the last segment must be complete
+					for (std::streamoff prev = headerend; io.tellg() < headerend; ) {
+						auto p = read_primitive<std::streamoff>( io );
+						read_primitive<uint64_t>( io );
+						if (p < prev || p > size)
+							throw std::invalid_argument("invalid header end positions, input may be truncated");
+						prev = p;
+					}
+				}
+			} while (next != 0);
+			in.seekg(0, std::ios_base::end);
+			if (in.tellg() == 0)	return;
+
+			//compress to the end, and link the new segment only when it is complete
+			io.seekp(0, std::ios_base::end);
+			std::streamoff start = io.tellp();
+			compress_segment( in, io, ctx );
+			io.seekp( last + w );
+			write_primitive<std::streamoff>( start, io );
+			io.seekp(0, std::ios_base::end);
+			io.flush();
 		};
 
 		//! compresses input.
@@ -159,43 +1062,143 @@ class block_compressor {
 			return out.str();
 		};
 
+		//! returns the maximal size of an encoding of n bytes using the current block size.
+		size_t compress_bound( size_t n ) const {
+			size_t b = n / get_block_size() + (n % get_block_size() != 0);
+			//format tag, header, and mode (and checksum) of each stored block
+			return FORMAT_TAG_SIZE + (b + 2) * sizeof(std::streamoff) + b * sizeof(uint64_t)
+			     + b * (1 + (checksums ? sizeof(uint32_t) : 0)) + n;
+		};
+
+		//! compresses in[0..n-1] into out[0..capacity-1] and returns the size of the encoding.
+		/*! compression does not copy the input and never runs out of space if capacity is at
+		  least compress_bound( n ), otherwise an invalid argument exception is thrown if the
+		  encoding does not fit. If a context is given, memory of blocks is reused from previous
+		  compressions (see compression_context). Other exceptions are thrown as by compress.
+		 */
+		size_t compress( const char *in, size_t n, char *out, size_t capacity,
+		                 compression_context *ctx = nullptr ) const {
+			span_istreambuf ib( in, n );
+			span_ostreambuf ob( out, capacity );
+			std::istream is( &ib );
+			std::ostream os( &ob );
+			try {
+				compress( is, os, ctx );
+			} catch (std::ios_base::failure &) {
+				if (ob.exhausted())	throw std::invalid_argument("output buffer is too small");
+				throw;
+			}
+			return ob.size();
+		};
+
 		//! decompresses a compressed input.
 		/*! instream and outstream should not point to the same direction.
 		  function throws a runtime error if decoding failed, an invalid 
 		  argument exception if encoding was manipulated or a stream exception
 		  if input or output stream streams make problems
-		  IMPORTANT NOTE: it is not ensured that encoding manipulation is detected,
-		  as this is experimental code without checksums
+		  IMPORTANT NOTE: manipulated texts of blocks are detected (with high probability)
+		  only if the input was compressed with checksums (see set_checksums)
 		*/
 		void decompress( std::istream &in, std::ostream &out ) const {
 			//set exception mask of streams
 			in.exceptions( std::istream::badbit | std::istream::eofbit );
 			out.exceptions( std::ostream::badbit );
 
-			//read header
-			std::forward_list<std::streampos> blockend;
-			blockend.push_front( read_primitive<std::streamoff>( in ) );
+			//decompress each block
+			int64_t i = 0;
+			for (auto &b : read_header( in )) {
+				stage_scope scope( *this, i++, "decode" );
+				in.seekg( b.start );
+				decode_or_copy( in, b.end, out );
+			}
 
-			auto it = blockend.begin();
-			while (in.tellg() != blockend.front()) {
-				auto p = read_primitive<std::streamoff>( in );
-				if (p < *it)
-					throw std::invalid_argument("invalid header end positions");
+			//leave streams in good state
+			out.flush();
+		};
+
+		//! decompresses blocks first, ..., first+count-1 of a compressed input.
+		/*! only these blocks are decoded, so in must be seekable. Blocks of an input have
+		  the block size used for compression (except the last one). Exceptions are thrown
+		  as by decompress, an invalid argument exception if the blocks do not exist.
+		 */
+		void decompress_blocks( std::istream &in, uint64_t first, uint64_t count, std::ostream &out ) const {
+			//set exception mask of streams
+			in.exceptions( std::istream::badbit | std::istream::eofbit );
+			out.exceptions( std::ostream::badbit );
 
-				it = blockend.insert_after( it, p );
+			in.seekg( 0 );
+			auto blocks = read_header( in );
+			if (first + count > blocks.size()) {
+				throw std::invalid_argument("block does not exist");
 			}
-			print_info("number of blocks", std::distance(blockend.begin(), blockend.end())-1 );
-			
-			//decompress each block
-			blockend.pop_front();
-			for (auto be : blockend) {
-				decompress_block( in, be, out );
-				if (in.tellg() != be) {
-					throw std::invalid_argument("invalid block decompression");
-				}
+			for (uint64_t i = first; i < first + count; i++) {
+				stage_scope scope( *this, i, "decode" );
+				in.seekg( blocks[i].start );
+				decode_or_copy( in, blocks[i].end, out );
 			}
+			out.flush();
+		};
 
-			//leave streams in good state
+		//! decompresses len bytes at position offset of the text of a compressed input.
+		/*! only the blocks covering the range are decoded, so in must be seekable. If a cache
+		  is given, the header and blocks of the input are kept in it for further ranges
+		  (see block_cache). Exceptions are thrown as by decompress, an invalid argument
+		  exception if the range exceeds the text.
+		 */
+		void decompress_range( std::istream &in, uint64_t offset, uint64_t len, std::ostream &out,
+		                       block_cache *cache = nullptr ) const {
+			//set exception mask of streams
+			in.exceptions( std::istream::badbit | std::istream::eofbit );
+			out.exceptions( std::ostream::badbit );
+
+			std::shared_ptr<const std::vector<block_info>> header;
+			if (cache != nullptr) {
+				header = cache->header( *this, in );
+			} else {
+				in.seekg( 0 );
+				header = std::make_shared<const std::vector<block_info>>( read_header( in ) );
+			}
+			const std::vector<block_info> &blocks = *header;
+
+			//check the range first, such that nothing is written if it exceeds the text
+			uint64_t total = 0;
+			for (auto &b : blocks)
+				total += b.size;
+			if (offset > total || len > total - offset) {
+				throw std::invalid_argument("range exceeds the decompressed text");
+			}
+
+			//pos is the position of block i in the text
+			uint64_t pos = 0;
+			for (size_t i = 0; i < blocks.size() && len > 0; pos += blocks[i].size, i++) {
+				if (pos + blocks[i].size <= offset)	continue;
+				stage_scope scope( *this, i, "decode" );
+				uint64_t skip = offset - pos, take = std::min( blocks[i].size - skip, len );
+				std::shared_ptr<const std::string> data;
+				if (cache != nullptr && !(data = cache->get( i ))) {
+					std::ostringstream dec;
+					dec.exceptions( std::ostream::badbit );
+					in.seekg( blocks[i].start );
+					decode_or_copy( in, blocks[i].end, dec );
+					data = std::make_shared<const std::string>( dec.str() );
+					cache->put( i, data );
+				}
+				if (data && data->size() != blocks[i].size) {
+					throw std::invalid_argument("invalid block size");
+				} else if (data) {
+					out.write( data->data() + skip, take );
+				} else {
+					//decode directly, passing only the range to out
+					window_ostreambuf wb( out, skip, take );
+					std::ostream win( &wb );
+					win.exceptions( std::ostream::badbit );
+					in.seekg( blocks[i].start );
+					decode_or_copy( in, blocks[i].end, win );
+					win.flush();
+				}
+				offset += take;
+				len -= take;
+			}
 			out.flush();
 		};
 
@@ -203,8 +1206,8 @@ class block_compressor {
 		/*! function throws a runtime error if decoding failed, an invalid 
 		  argument exception if encoding was manipulated or a stream exception
 		  if input or output stream streams make problems
-		  IMPORTANT NOTE: it is not ensured that encoding manipulation is detected,
-		  as this is experimental code without checksums
+		  IMPORTANT NOTE: manipulated texts of blocks are detected (with high probability)
+		  only if the input was compressed with checksums (see set_checksums)
 		*/
 		std::string decompress( const std::string &Enc ) const {
 			std::istringstream in( Enc );
@@ -213,6 +1216,138 @@ class block_compressor {
 			return out.str();
 		};
 
+		//! decompresses in[0..n-1] into out[0..capacity-1] and returns the size of the text.
+		/*! the text is decoded directly into out, an invalid argument exception is thrown
+		  if it does not fit. Other exceptions are thrown as by decompress.
+		 */
+		size_t decompress( const char *in, size_t n, char *out, size_t capacity ) const {
+			span_istreambuf ib( in, n );
+			span_ostreambuf ob( out, capacity );
+			std::istream is( &ib );
+			std::ostream os( &ob );
+			try {
+				decompress( is, os );
+			} catch (std::ios_base::failure &) {
+				if (ob.exhausted())	throw std::invalid_argument("output buffer is too small");
+				throw;
+			}
+			return ob.size();
+		};
+
+		//! transcodes an input compressed by compressor from into an encoding of this compressor.
+		/*! blocks are decoded only up to the transformed text if both compressors share
+		  the same transformation (see transformation()), so transcoding between different
+		  second stages avoids the transformation and its inversion. Otherwise, blocks are
+		  decompressed and compressed again. Exceptions are thrown as by decompress and compress.
+		 */
+		void transcode( std::istream &in, std::ostream &out, const block_compressor &from ) const {
+			//set exception mask of streams
+			in.exceptions( std::istream::badbit | std::istream::eofbit );
+			out.exceptions( std::ostream::badbit );
+
+			auto inblocks = from.read_header( in );
+			std::forward_list<std::streampos> blockend;
+			std::vector<uint64_t> sizes;
+			for (auto &b : inblocks)
+				sizes.push_back( b.size );
+			write_format( out );
+			std::streampos start = out.tellp();
+			for (size_t i = 0; i <= 2*inblocks.size()+1; i++) //make place for header
+				write_primitive<std::streamoff>( 0, out );
+			blockend.push_front( out.tellp() );
+
+			//transcode each block, keeping its mode unless the new encoding is not smaller
+			// than the text (as in encode_or_store), such that compress_bound still holds
+			auto it = blockend.begin();
+			int64_t i = 0;
+			text_t enc;
+			for (auto &b : inblocks) {
+				auto be = b.end;
+				stage_scope scope( *this, i++, "transcode" );
+				in.seekg( b.start );
+				auto mode = in.get();
+				bool checked = (mode != EOF && (mode & BLOCK_CHECKSUM));
+				uint32_t crc = checked ? read_primitive<uint32_t>( in ) : 0; //text is unchanged, keep its checksum
+				if (checked)	mode &= ~BLOCK_CHECKSUM;
+				auto put_mode = [&]( char m ) {
+					out.put( checked ? (char)(m | BLOCK_CHECKSUM) : m );
+					if (checked)	write_primitive<uint32_t>( crc, out );
+				};
+				if (mode == BLOCK_STORED) {
+					put_mode( BLOCK_STORED );
+					copy_stored( in, be, out );
+					if (in.tellg() != be) {
+						throw std::invalid_argument("invalid block decompression");
+					}
+				} else if (mode == BLOCK_ENCODED || mode == BLOCK_DEDUP) {
+					std::string side;
+					if (mode == BLOCK_DEDUP)	side = read_dedup( in, be );
+					vector_ostreambuf<text_t> eb( enc );
+					std::ostream tout( &eb );
+					tout.exceptions( std::ostream::badbit );
+					transcode_block( in, be, tout, from );
+					if (in.tellg() != be) {
+						throw std::invalid_argument("invalid block decompression");
+					}
+					uint64_t e = (side.empty() ? 0 : sizeof(uint64_t) + side.size()) + eb.size();
+					if (e < b.size) {
+						put_mode( (char)mode );
+						if (!side.empty()) {
+							write_primitive<uint64_t>( side.size(), out );
+							out.write( side.data(), side.size() );
+						}
+						out.write( eb.data(), eb.size() );
+					} else {
+						//store the text, decoded by from (which verifies its checksum)
+						text_t text;
+						vector_ostreambuf<text_t> tb( text );
+						std::ostream dec( &tb );
+						dec.exceptions( std::ostream::badbit );
+						in.seekg( b.start );
+						from.decode_or_copy( in, be, dec );
+						dec.flush();
+						if (tb.size() != b.size) {
+							throw std::invalid_argument("invalid block size");
+						}
+						put_mode( BLOCK_STORED );
+						out.write( tb.data(), tb.size() );
+					}
+				} else {
+					throw std::invalid_argument("invalid block mode");
+				}
+				it = blockend.insert_after( it, out.tellp() );
+			}
+
+			write_header( start, blockend, sizes, out );
+		};
+
+		//! returns an id of the encodings of this compressor.
+		/*! the id is stored in the format tag of each encoding, such that decompressing
+		  or appending to encodings of other compressors fails before anything is written.
+		 */
+		virtual uint32_t format_id() const {
+			return 0;
+		};
+
+		//! returns a name of the transformation of this compressor.
+		/*! compressors with the same transformation differ only in the coding of transformed
+		  texts, which decode_transformed and encode_transformed provide. The default is
+		  an empty name, meaning the transformation is not shared with other compressors.
+		 */
+		virtual std::string transformation() const {
+			return "";
+		};
+
+		//! decodes a transformed text encoded by encode_transformed. t must have the size of the text.
+		virtual void decode_transformed( std::istream &, text_t & ) const {
+			throw std::logic_error("compressor has no shared transformation");
+		};
+
+		//! encodes a transformed text t to out.
+		virtual void encode_transformed( text_t &, std::ostream & ) const {
+			throw std::logic_error("compressor has no shared transformation");
+		};
+
 		//! utility for writing POD types to a stream.
 		template<class T>
 		static void write_primitive( T p, std::ostream &out ) {
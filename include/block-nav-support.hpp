@@ -39,7 +39,7 @@ class block_nav_support {
 		const t_size_t mbh = 2; //minimal block height
 
 		std::vector<t_idx_t> m_end; //end position of blocks (see below)
-		std::vector<t_idx_t> collisions; //map for collisions
+		t_idx_vector_t collisions; //map for collisions
 
 		void compute_blocks();
 		void init_empty_collision_map();
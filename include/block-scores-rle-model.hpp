@@ -27,6 +27,7 @@
 #include "aux-encoding.hpp"
 #include "bwt-config.hpp"
 #include "bwt-run-support.hpp"
+#include "run-scanner.hpp"
 #include "twobitvector.hpp"
 
 #include <algorithm>
@@ -166,19 +167,11 @@ public:
 			                   tbwt_idx,
 			                   (t_idx_t)tbwt.size()}; //don't forget primary index run
 		for (t_idx_t ib = 0; ib != 2; ib++) {
-			t_idx_t i = bounds[ib];
-			t_idx_t e = bounds[ib+1];
-
-			bool newrun = true;
-			while (++i < e) {
-				if (tbwt[i] != tbwt[i-1]) { //new run detected
-					newrun = true;
-				}
-				else if (newrun) { //first run-character of new run
-					aux[j++] = aux[i]; //copy aux-value of runs with height > 1
-					newrun = false;
+			run_scanner::for_each_run( tbwt.data(), bounds[ib], bounds[ib+1], [&]( size_t i, size_t len ) {
+				if (len > 1u) { //copy aux-value of first run-character of runs with height > 1
+					aux[j++] = aux[i+1];
 				}
-			}
+			});
 		}
 		aux.resize( j );
 	}
@@ -199,24 +192,13 @@ public:
 		aux[tbwt.size()] = aux_encoding::REG;
 
 		for (t_idx_t ib = 0; ib != 2; ib++) {
-			t_idx_t i = bounds[ib];
-			t_idx_t e = bounds[ib+1];
-
-			bool newrun = true;
-			while (--i > e) {
-				if (tbwt[i] != tbwt[i-1]) { //start of a run
-					aux[i] = aux_encoding::REG;
-					newrun = true;
+			run_scanner::for_each_run_reverse( tbwt.data(), bounds[ib+1], bounds[ib], [&]( size_t i, size_t len ) {
+				if (len > 1u) { //all run-characters share one aux-value
+					if (j-- == 0u) throw std::invalid_argument("invalid aux encoding");
+					aux.fill( i+1, i+len, aux[j] );
 				}
-				else {
-					if (newrun) {
-						if (j-- == 0u) throw std::invalid_argument("invalid aux encoding");
-						newrun = false;
-					}
-					aux[i] = aux[j];
-				}
-			}
-			aux[i] = aux_encoding::REG; //set flag for start of last run
+				aux[i] = aux_encoding::REG; //set flag for start of run
+			});
 		}
 	}
 };
@@ -0,0 +1,86 @@
+/*
+ * bounded-queue.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _BOUNDED_QUEUE_HPP
+#define _BOUNDED_QUEUE_HPP
+
+#include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+//! a thread-safe FIFO queue with limited capacity.
+/*! push blocks while the queue is full, pop blocks while the queue is empty.
+   After close was called, push fails and pop fails as soon as the queue is empty.
+*/
+template<class T>
+class bounded_queue {
+	private:
+		std::deque<T> q;
+		size_t capacity;
+		bool closed = false;
+		std::mutex m;
+		std::condition_variable not_full;
+		std::condition_variable not_empty;
+	public:
+		//! constructor, expects the maximal number of queued elements.
+		bounded_queue( size_t cap ) : capacity( cap ) {
+			assert( cap > 0 );
+		};
+
+		//! appends v to the queue. Returns false if the queue was closed.
+		bool push( T &&v ) {
+			std::unique_lock<std::mutex> lock( m );
+			not_full.wait( lock, [this]() { return closed || q.size() < capacity; } );
+			if (closed)	return false;
+			q.push_back( std::move( v ) );
+			not_empty.notify_one();
+			return true;
+		};
+
+		//! removes the first element of the queue and stores it in v.
+		//! Returns false if the queue is closed and empty.
+		bool pop( T &v ) {
+			std::unique_lock<std::mutex> lock( m );
+			not_empty.wait( lock, [this]() { return closed || !q.empty(); } );
+			if (q.empty())	return false;
+			v = std::move( q.front() );
+			q.pop_front();
+			not_full.notify_one();
+			return true;
+		};
+
+		//! closes the queue, such that no more elements can be pushed.
+		/*! if discard is set, queued elements are dropped as well.
+		*/
+		void close( bool discard = false ) {
+			std::lock_guard<std::mutex> lock( m );
+			closed = true;
+			if (discard)	q.clear();
+			not_full.notify_all();
+			not_empty.notify_all();
+		};
+};
+
+#endif
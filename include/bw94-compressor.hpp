@@ -31,19 +31,27 @@
 #include "bwt-run-support.hpp"
 #include "entropy-coder.hpp"
 #include "mtf-coder.hpp"
-#include "rle0-coder.hpp"
+#include "mtf-rle0-coder.hpp"
 #include "twobitvector.hpp"
 
 #include "block-scores-rle-model.hpp"
 
+#include <algorithm>
 #include <istream>
 #include <limits>
 #include <ostream>
 #include <stdexcept>
+#include <vector>
 
 //! class which encodes a BWT with MTF + RLE0 + Entropy as second stage
 class BW_SS_BW94 : public block_scores_rle_model {
+private:
+	//number of characters transformed at once
+	static const t_idx_t CHUNK_SIZE = 1u << 16;
 public:
+	//! id of this second stage in the format tag of encodings (see block_compressor::format_id)
+	static const uint32_t FORMAT_ID = 1;
+
 	//! encodes the transform t using MTF + RLE0 + Entropy
 	template<class T>
 	static void encode( T &t, std::ostream &out ) {
@@ -55,22 +63,21 @@ public:
 		}
 
 		//prepare encoders
-		mtf_coder<T> mtfcoder( alph );
-		rle0_encoder<T> rle0coder;
+		mtf_rle0_encoder<T> mtfrle0coder( alph );
 		entropy_encoder<std::ostream> entcoder( out );
 		entcoder.reset( alph.size() + 1 );
 
-		for (t_idx_t i = 0; i < t.size(); ) { //do encoding
-			do {
-				if (i >= t.size())	break;
-				//feed rle0-encoder with mtf coded input until some contents can be written
-			} while (rle0coder.encode_char( mtfcoder.encode_char( t[i++] ) ));
-
-			//move the output of the rle0coder to the entropy coder
-			while (rle0coder.has_next_enc_char()) {
-				entcoder.encode_char( rle0coder.next_enc_char() );
-			}
+		//transform chunks of t using MTF + RLE0, and entropy code the resulting symbols
+		std::vector<typename mtf_rle0_encoder<T>::symbol_type> sym;
+		sym.reserve( CHUNK_SIZE );
+		for (t_idx_t i = 0; i < t.size(); i += CHUNK_SIZE) {
+			sym.clear();
+			mtfrle0coder.encode( t, i, std::min( (t_idx_t)t.size(), i + CHUNK_SIZE ), sym );
+			entcoder.encode_chars( sym.begin(), sym.end() );
 		}
+		sym.clear();
+		mtfrle0coder.flush( sym );
+		entcoder.encode_chars( sym.begin(), sym.end() );
 		entcoder.flush();
 	}
 
@@ -93,24 +100,26 @@ public:
 		}
 
 		//set up required decodes
-		mtf_coder<T> mtfcoder( alph );
-		rle0_decoder<T> rle0coder;
+		mtf_rle0_decoder<T> mtfrle0coder( alph );
 		entropy_decoder<std::istream> entcoder( in );
 		entcoder.reset( alph.size() + 1 );
 
-		//do decoding
-		for (t_idx_t i = 0; i < t.size(); entcoder.next() ) {
-			//feed rle0-decoder with input
-			rle0coder.decode_char( entcoder.decode_char() );
-
-			//fetch characters from rle0-decoder and invert mtf
-			while (i < t.size() && rle0coder.has_next_char()) {
-				t[i++] = mtfcoder.decode_char( rle0coder.next_char() );
+		//do decoding, collect chunks of symbols and decode them as a whole
+		std::vector<typename mtf_rle0_decoder<T>::symbol_type> sym;
+		sym.reserve( CHUNK_SIZE );
+		t_size_t i = 0; //decoded characters written to t
+		for (t_size_t d = 0; d < t.size(); entcoder.next() ) {
+			sym.push_back( entcoder.decode_char() );
+			d = mtfrle0coder.count( sym.back() );
+			if (d > t.size()) {
+				throw std::invalid_argument("encoded rle0-sequence is longer than text length");
+			}
+			if (sym.size() == CHUNK_SIZE) {
+				i = mtfrle0coder.decode( sym.data(), sym.data() + sym.size(), t, i );
+				sym.clear();
 			}
 		}
-		if (rle0coder.has_next_char()) {
-			throw std::invalid_argument("encoded rle0-sequence is longer than text length");
-		}
+		mtfrle0coder.decode( sym.data(), sym.data() + sym.size(), t, i );
 	}
 };
 
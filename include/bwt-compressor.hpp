@@ -27,74 +27,166 @@
 #include "block-compressor.hpp"
 #include "bwt-config.hpp"
 #include "divsufsort.h"
+#include "huge-page-allocator.hpp"
+#include "semi-external-bwt.hpp"
+#include "packed-bwt.hpp"
 
+#include <algorithm>
+#include <array>
 #include <assert.h>
 #include <chrono>
 #include <ios>
 #include <limits>
+#include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <stdint.h>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+//! inverts the bwt S with primary index idx (as computed by divbwt) in place, using LF
+//! (of at least S.size() entries) as working space.
+/*! the inversion equals inverse_bw_transform of divsufsort, but checks that the walk
+   through the text visits the row of the sentinel exactly at its end, so an invalid bwt
+   throws an invalid_argument instead of reading in front of LF.
+ */
+template<class t_vector>
+void invert_bwt( t_string_t &S, t_idx_t idx, t_vector &LF ) {
+	const t_size_t n = S.size();
+	if (n <= 1)	return;
+	if (idx == 0 || idx > n) {
+		throw std::invalid_argument("Inverse BW Transformation failed");
+	}
+
+	//compute start positions of the characters in use
+	std::array<t_size_t,256> C{};
+	std::array<uint8_t,256> D; //characters in use
+	unsigned d = 0;
+	for (t_size_t i = 0; i < n; i++)	++C[S[i]];
+	for (t_size_t c = 0, j = 0; c < C.size(); c++) {
+		auto cnt = C[c];
+		if (cnt > 0) {
+			C[c] = j;
+			D[d++] = c;
+			j += cnt;
+		}
+	}
+
+	//compute LF, where the row of the sentinel is row 0, and C afterwards holds the end of each character
+	for (t_size_t i = 0; i < idx; i++)	LF[C[S[i]]++] = i;
+	for (t_size_t i = idx; i < n; i++)	LF[C[S[i]]++] = i + 1;
+	for (unsigned c = 0; c < d; c++)	C[c] = C[D[c]];
+
+	//walk through the text, starting behind the sentinel
+	t_size_t p = idx;
+	for (t_size_t i = 0; i < n; i++) {
+		if (p == 0)	throw std::invalid_argument("Inverse BW Transformation failed");
+		S[i] = D[std::lower_bound( C.begin(), C.begin() + d, p ) - C.begin()];
+		p = LF[p-1];
+	}
+	if (p != 0)	throw std::invalid_argument("Inverse BW Transformation failed");
+}
 
 //! a bwt-based compressor with second stage transform as defined in t_2st_encoder
 template<class t_2st_encoder>
 class bwt_compressor : public block_compressor {
+	private:
+		//state of a block after its BW-transformation
+		struct bwt_block_state : public block_state {
+			saidx_t bwt_idx = 0;
+		};
 	public:
 		//! constructor
 		bwt_compressor() : block_compressor( t_max_size ) {};
+
+		virtual uint32_t format_id() const {
+			return t_2st_encoder::FORMAT_ID;
+		};
+		virtual std::string transformation() const {
+			return "bwt";
+		};
+		virtual void decode_transformed( std::istream &in, text_t &t ) const {
+			t_2st_encoder::decode( in, t );
+		};
+		virtual void encode_transformed( text_t &t, std::ostream &out ) const {
+			t_2st_encoder::encode( t, out );
+		};
 	protected:
-		virtual void compress_block( std::istream &in, std::streampos end, std::ostream &out ) const;
 		virtual void decompress_block( std::istream &in, std::streampos end, std::ostream &out ) const;
+		virtual void transcode_block( std::istream &in, std::streampos end, std::ostream &out,
+		                              const block_compressor &from ) const;
+
+		virtual std::unique_ptr<block_state> make_block_state() const {
+			return std::unique_ptr<block_state>( new bwt_block_state() );
+		};
+		virtual void transform_block( block_state &bs ) const;
+		virtual void encode_block( block_state &bs, std::ostream &out ) const;
 };
 
 //// COMPRESSION //////////////////////////////////////////////////////////////
 
 template<class t_ss_e>
-void bwt_compressor<t_ss_e>::compress_block( std::istream &in, std::streampos end, std::ostream &out ) const {
+void bwt_compressor<t_ss_e>::transform_block( block_state &bs ) const {
 	using namespace std;
 	using namespace std::chrono;
-	typedef typename istream::char_type schar_t;
 	typedef high_resolution_clock timer;
-	static_assert( is_same<
-	                    typename make_unsigned<schar_t>::type,
-	                    typename make_unsigned<t_uchar_t>::type
-	               >::value,
+	static_assert( is_same< t_string_t, decltype(bs.data) >::value,
 	               "character types must be compatible" );
 
 	//// GET INPUT ////////////////////////////////////////////////////////
 
-	//get length of input
-	t_size_t n = (t_size_t)(end - in.tellg());
+	t_string_t &S = bs.data;
+	t_size_t n = S.size();
 	assert(n <= t_max_size );
-	print_info("input size", n);
-
-	//read string from input
-	t_string_t S( n );
-	in.read( (schar_t *)S.data(), n );
+	record_bytes("input size", n);
 
 	//// BW-TRANSFORM INPUT ///////////////////////////////////////////////
 
+	auto counters = start_counters();
 	auto start = timer::now();
-	saidx_t bwt_idx = 0;
-	if (bw_transform(S.data(), S.data(), NULL, (saidx_t)n, &bwt_idx) < 0) {
+	saidx_t &bwt_idx = static_cast<bwt_block_state &>( bs ).bwt_idx;
+	if (get_memory_budget() != 0 && (uint64_t)n * (1 + sizeof(saidx_t)) > get_memory_budget()) {
+		//text and suffix array do not fit into the budget, construct suffix array on disk
+		print_info("bwt construction", "semi-external");
+		bwt_idx = semi_external_bwt( S, get_scratch_dir() );
+	} else {
+		//provide the suffix array space, such that it follows the memory policy and is
+		//reused by compressions sharing a context
+		scratch_memory SA( bs );
+		bwt_idx = divbwt(S.data(), S.data(), SA.array<saidx_t>( n+1 ), (saidx_t)n);
+	}
+	if (bwt_idx < 0) {
 		throw runtime_error( string("BW Transformation failed") );
 	}
 	auto stop = timer::now();
-	print_info("bwt construction time", (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>( stop - start ).count() );
+	record_counters("bwt construction", counters );
+	record_duration("bwt construction time", stop - start );
+	print_info("memory policy", memory_policy::used() );
+}
+
+template<class t_ss_e>
+void bwt_compressor<t_ss_e>::encode_block( block_state &bs, std::ostream &out ) const {
+	using namespace std;
+	using namespace std::chrono;
+	typedef high_resolution_clock timer;
+
+	t_string_t &S = bs.data;
+	saidx_t bwt_idx = static_cast<bwt_block_state &>( bs ).bwt_idx;
 
 	//// WRITE HEADER AND ENCODING TO STREAM //////////////////////////////
-	start = timer::now();
+	auto counters = start_counters();
+	auto start = timer::now();
 
 	write_primitive<t_size_t>( S.size(), out );
 	write_primitive<t_idx_t>( bwt_idx , out );
 	auto bwencstartpos = out.tellp();
 	t_ss_e::encode( S, out );	
 
-	stop = timer::now();
-	print_info("encoding time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
-	print_info("bwt encoding size", out.tellp() - bwencstartpos );
+	auto stop = timer::now();
+	record_counters("encoding", counters );
+	record_duration("encoding time", stop - start );
+	record_bytes("bwt encoding size", out.tellp() - bwencstartpos );
 }
 
 //// DECOMPRESSION ////////////////////////////////////////////////////////////
@@ -113,6 +205,7 @@ void bwt_compressor<t_ss_e>::decompress_block( std::istream &in, std::streampos
 
 	//// READ INPUT ///////////////////////////////////////////////////////
 
+	auto counters = start_counters();
 	auto start = timer::now();
 	//read header
 	auto n       = read_primitive<t_size_t>( in );
@@ -129,20 +222,76 @@ void bwt_compressor<t_ss_e>::decompress_block( std::istream &in, std::streampos
 	t_ss_e::decode( in, S );
 
 	auto stop = timer::now();
-	print_info("decoding time", (uint64_t)duration_cast<milliseconds>( stop - start ).count());
+	record_counters("decoding", counters );
+	record_duration("decoding time", stop - start );
 
 	//// INVERT BWT ///////////////////////////////////////////////////////
 
+	counters = start_counters();
 	start = timer::now();
-	if (inverse_bw_transform(S.data(), S.data(), NULL,
-	                         (saidx_t)S.size(), (saidx_t)bwt_idx) < 0) {
-		throw invalid_argument( "Inverse BW Transformation failed" );		
+	if (invert_small_alphabet_bwt( S, bwt_idx )) {
+		print_info("bwt inversion", "packed");
+	} else {
+		//provide the LF space, such that it follows the memory policy
+		std::vector<saidx_t, huge_page_allocator<saidx_t>> LF( n );
+		invert_bwt( S, bwt_idx, LF );
 	}
 	stop = timer::now();
-	print_info("bwt inversion time", (uint64_t)duration_cast<milliseconds>( stop - start ).count());
+	record_counters("bwt inversion", counters );
+	record_duration("bwt inversion time", stop - start );
+	print_info("memory policy", memory_policy::used() );
 
 	//// WRITE S TO OUTPUTSTREAM //////////////////////////////////////////
 	out.write( (const schar_t *)S.data(), S.size() );
 }
 
+//// TRANSCODING //////////////////////////////////////////////////////////////
+
+template<class t_ss_e>
+void bwt_compressor<t_ss_e>::transcode_block( std::istream &in, std::streampos end, std::ostream &out,
+                                              const block_compressor &from ) const {
+	using namespace std;
+	using namespace std::chrono;
+	typedef high_resolution_clock timer;
+
+	if (from.transformation() != transformation()) {
+		block_compressor::transcode_block( in, end, out, from );
+		return;
+	}
+
+	//// DECODE BWT WITH SECOND STAGE OF SOURCE ///////////////////////////
+
+	auto counters = start_counters();
+	auto start = timer::now();
+	auto n       = read_primitive<t_size_t>( in );
+	auto bwt_idx = read_primitive<t_idx_t>( in );
+	if (n > t_max_size) {
+		throw invalid_argument("text(part) is too long to be decoded!");
+	}
+	if (n != 0 && (bwt_idx >= n || bwt_idx == 0)) {
+		throw invalid_argument("invalid bwt index");
+	}
+	t_string_t S( n );
+	from.decode_transformed( in, S );
+	if (in.tellg() != end) {
+		throw invalid_argument("invalid bwt encoding size");
+	}
+	auto stop = timer::now();
+	record_counters("decoding", counters );
+	record_duration("decoding time", stop - start );
+
+	//// ENCODE BWT WITH OWN SECOND STAGE /////////////////////////////////
+
+	counters = start_counters();
+	start = timer::now();
+	write_primitive<t_size_t>( n, out );
+	write_primitive<t_idx_t>( bwt_idx , out );
+	auto bwencstartpos = out.tellp();
+	t_ss_e::encode( S, out );
+	stop = timer::now();
+	record_counters("encoding", counters );
+	record_duration("encoding time", stop - start );
+	record_bytes("bwt encoding size", out.tellp() - bwencstartpos );
+}
+
 #endif
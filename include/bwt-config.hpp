@@ -24,6 +24,8 @@
 #ifndef _BWT_CONFIG_HPP
 #define _BWT_CONFIG_HPP
 
+#include "huge-page-allocator.hpp"
+
 #include <limits>
 #include <stdint.h>
 #include <vector>
@@ -32,7 +34,8 @@ typedef uint8_t  t_uchar_t;
 typedef uint32_t t_size_t;
 typedef uint32_t t_idx_t;
 typedef int64_t  t_bitsize_t;
-typedef typename std::vector<t_uchar_t> t_string_t;
+typedef typename std::vector<t_uchar_t, huge_page_allocator<t_uchar_t>> t_string_t;
+typedef typename std::vector<t_idx_t, huge_page_allocator<t_idx_t>> t_idx_vector_t; //for big, randomly accessed arrays
 
 const t_size_t t_max_size = (1024ul + 512ul)*1024ul*1024ul; //maximal size of input (1,5 GB)
 
@@ -49,8 +49,8 @@ class bwt_run_support {
 		t_size_t m_sigma; //size of alphabet
 		t_size_t m_max_char_val; //maximal value of an element in alphabet
 
-		std::vector<t_idx_t> m_lfr; //lf, only for the start of runs
-		std::vector<t_idx_t> m_rs; //start positions of all runs, sorted ascending.
+		t_idx_vector_t m_lfr; //lf, only for the start of runs
+		t_idx_vector_t m_rs; //start positions of all runs, sorted ascending.
 		                           //additionally, m_rs[m_runs] = n+1 holds.
 
 	public:
@@ -0,0 +1,186 @@
+/*
+ * crc32c.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _CRC32C_HPP
+#define _CRC32C_HPP
+
+#include <algorithm>
+#include <array>
+#include <stddef.h>
+#include <stdint.h>
+#include <streambuf>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <nmmintrin.h>
+#endif
+
+//! CRC32C (Castagnoli polynomial) checksums of byte sequences.
+/*! uses the crc32 instruction of SSE4.2 if the processor supports it (checked once at
+   runtime), and a table-driven implementation (slicing by 8) otherwise.
+ */
+class crc32c {
+	private:
+		static const uint32_t POLY = 0x82f63b78; //reflected Castagnoli polynomial
+
+		//tables for slicing by 8, table k advances a byte by k further bytes
+		static const std::array<std::array<uint32_t,256>,8> &tables() {
+			static const std::array<std::array<uint32_t,256>,8> t = []() {
+				std::array<std::array<uint32_t,256>,8> t;
+				for (uint32_t i = 0; i < 256; i++) {
+					uint32_t c = i;
+					for (int j = 0; j < 8; j++)	c = (c >> 1) ^ ((c & 1) ? POLY : 0);
+					t[0][i] = c;
+				}
+				for (size_t k = 1; k < 8; k++) {
+					for (size_t i = 0; i < 256; i++)	t[k][i] = (t[k-1][i] >> 8) ^ t[0][t[k-1][i] & 0xff];
+				}
+				return t;
+			}();
+			return t;
+		};
+
+		static uint32_t update_table( uint32_t c, const unsigned char *p, size_t n ) {
+			const auto &t = tables();
+			for (; n >= 8; p += 8, n -= 8) {
+				uint32_t lo, hi;
+				memcpy( &lo, p, 4 );
+				memcpy( &hi, p + 4, 4 );
+				lo ^= c; //little endian byte order assumed, as on all supported platforms
+				c = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+				  ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+			}
+			for (; n > 0; p++, n--)	c = (c >> 8) ^ t[0][(c ^ *p) & 0xff];
+			return c;
+		};
+
+#if defined(__x86_64__) && defined(__GNUC__)
+		__attribute__((target("sse4.2")))
+		static uint32_t update_sse42( uint32_t c, const unsigned char *p, size_t n ) {
+			uint64_t c64 = c;
+			for (; n >= 8; p += 8, n -= 8) {
+				uint64_t v;
+				memcpy( &v, p, 8 );
+				c64 = _mm_crc32_u64( c64, v );
+			}
+			c = (uint32_t)c64;
+			for (; n > 0; p++, n--)	c = _mm_crc32_u8( c, *p );
+			return c;
+		};
+
+		static bool has_sse42() {
+			static const bool b = __builtin_cpu_supports("sse4.2");
+			return b;
+		};
+#endif
+	public:
+		//! returns the checksum of data[0..n-1] following a sequence with checksum crc (0 if none).
+		static uint32_t update( uint32_t crc, const void *data, size_t n ) {
+			const unsigned char *p = (const unsigned char *)data;
+			uint32_t c = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+			if (has_sse42())	return ~update_sse42( c, p, n );
+#endif
+			return ~update_table( c, p, n );
+		};
+
+		//! returns whether the checksum is computed by hardware instructions.
+		static bool accelerated() {
+#if defined(__x86_64__) && defined(__GNUC__)
+			return has_sse42();
+#else
+			return false;
+#endif
+		};
+};
+
+//! output stream buffer passing everything to another stream buffer while computing its checksum.
+/*! the checksum of each chunk is computed right before it is passed on, while it is
+   still in cache. Large writes are split into chunks of this size.
+ */
+class crc32c_ostreambuf : public std::streambuf {
+	private:
+		static const size_t CHUNK = 1 << 16;
+		std::streambuf *target;
+		uint32_t c = 0;
+		uint64_t n = 0;
+		std::vector<char> buf;
+
+		//passes the buffered characters on
+		bool flush_buffer() {
+			std::streamsize m = pptr() - pbase();
+			c = crc32c::update( c, pbase(), m );
+			n += m;
+			setp( buf.data(), buf.data() + CHUNK );
+			return target->sputn( buf.data(), m ) == m;
+		};
+	protected:
+		virtual int_type overflow( int_type ch ) {
+			if (!flush_buffer())	return traits_type::eof();
+			if (!traits_type::eq_int_type( ch, traits_type::eof() )) {
+				*pptr() = traits_type::to_char_type( ch );
+				pbump( 1 );
+			}
+			return traits_type::not_eof( ch );
+		};
+
+		virtual std::streamsize xsputn( const char *s, std::streamsize m ) {
+			if (m < (std::streamsize)(epptr() - pptr())) {
+				memcpy( pptr(), s, m );
+				pbump( (int)m );
+				return m;
+			}
+			if (!flush_buffer())	return 0;
+			for (std::streamsize r = m; r > 0; ) {
+				std::streamsize k = std::min( r, (std::streamsize)CHUNK );
+				c = crc32c::update( c, s, k );
+				n += k;
+				if (target->sputn( s, k ) != k)	return m - r;
+				s += k;
+				r -= k;
+			}
+			return m;
+		};
+
+		virtual int sync() {
+			return (flush_buffer() && target->pubsync() != -1) ? 0 : -1;
+		};
+	public:
+		//! constructor, expects the stream buffer receiving the characters.
+		crc32c_ostreambuf( std::streambuf *t ) : target( t ), buf( CHUNK ) {
+			setp( buf.data(), buf.data() + CHUNK );
+		};
+
+		//! returns the checksum of all characters passed on so far (call pubsync first).
+		uint32_t checksum() const {
+			return c;
+		};
+
+		//! returns the number of characters passed on so far (call pubsync first).
+		uint64_t size() const {
+			return n;
+		};
+};
+
+#endif
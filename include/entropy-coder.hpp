@@ -124,6 +124,14 @@ class entropy_encoder : public entropy_coder {
 			}
 		};
 
+		//! encodes all characters in [first..last), see encode_char.
+		template<class Iterator>
+		void encode_chars( Iterator first, Iterator last ) {
+			while (first != last) {
+				encode_char( *(first++) );
+			}
+		};
+
 		//! flushes this encoder, important to call after encoding process.
 		/*! passes through exceptions from the underlying stream
 		  , or throws an invalid_argument if range coder has problems
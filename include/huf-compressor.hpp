@@ -0,0 +1,127 @@
+/*
+ * huf-compressor.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef HUF_COMPRESSOR_HPP
+#define HUF_COMPRESSOR_HPP
+
+#include "bwt-compressor.hpp"
+#include "tbwt-compressor.hpp"
+
+#include "huffman-coder.hpp"
+#include "mtf-coder.hpp"
+#include "mtf-rle0-coder.hpp"
+
+#include "block-scores-rle-model.hpp"
+
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+//! class which encodes a BWT with MTF + RLE0 + semi-static Huffman as second stage
+/*! trades compression for speed compared to BW_SS_BW94, decoding is done using lookup tables.
+ */
+class BW_SS_HUF : public block_scores_rle_model {
+private:
+	//number of characters transformed at once
+	static const t_idx_t CHUNK_SIZE = 1u << 16;
+	//minimal number of symbols coded with the same set of huffman tables
+	static const t_idx_t HUF_CHUNK_SIZE = 1u << 20;
+public:
+	//! id of this second stage in the format tag of encodings (see block_compressor::format_id)
+	static const uint32_t FORMAT_ID = 4;
+
+	//! encodes the transform t using MTF + RLE0 + Huffman
+	template<class T>
+	static void encode( T &t, std::ostream &out ) {
+		//write alphabet
+		auto alph = mtf_coder<T>::compute_alph( t );
+		out.put( (t_uchar_t)alph.size() ); //store alphabet size (note that this stores 0 if full alphabet is used)
+		for (t_idx_t i = 0; i < alph.size(); i++) { //and the alphabet itself
+			out.put( alph[i] );
+		}
+		if (t.size() == 0) return;
+
+		//prepare encoders
+		mtf_rle0_encoder<T> mtfrle0coder( alph );
+		huffman_encoder<std::ostream> hufcoder( out, alph.size() + 1 );
+
+		//transform chunks of t using MTF + RLE0, and huffman code the collected symbols
+		std::vector<typename mtf_rle0_encoder<T>::symbol_type> sym;
+		sym.reserve( HUF_CHUNK_SIZE + CHUNK_SIZE );
+		for (t_idx_t i = 0; i < t.size(); i += CHUNK_SIZE) {
+			mtfrle0coder.encode( t, i, std::min( (t_idx_t)t.size(), i + CHUNK_SIZE ), sym );
+			if (sym.size() >= HUF_CHUNK_SIZE) {
+				hufcoder.encode_chunk( sym.data(), sym.data() + sym.size() );
+				sym.clear();
+			}
+		}
+		mtfrle0coder.flush( sym );
+		hufcoder.encode_chunk( sym.data(), sym.data() + sym.size() );
+		hufcoder.finish();
+	}
+
+	//! decodes the transform and stores it in t using MTF + RLE0 + Huffman (t must have length of output)
+	template<class T>
+	static void decode( std::istream &in, T &t ) {
+		t_size_t alphsize = in.get();
+		//check validity
+		if (alphsize == 0u) {
+			if (t.size() == 0) return;
+			alphsize = std::numeric_limits<t_uchar_t>::max()+1u; //remember that on full alphabet 0 is stored
+		}
+		if (alphsize > t.size())
+			throw std::invalid_argument("alphabet must be smaller than encoded string size");
+
+		//read alphabet
+		T alph; alph.resize( alphsize );
+		for (t_idx_t i = 0; i < alph.size(); i++) {
+			alph[i] = in.get();
+		}
+
+		//set up required decoders
+		mtf_rle0_decoder<T> mtfrle0coder( alph );
+		huffman_decoder<std::istream> hufcoder( in, alph.size() + 1 );
+
+		//decode chunks of symbols and retransform them
+		std::vector<typename mtf_rle0_decoder<T>::symbol_type> sym;
+		t_size_t i = 0; //decoded characters written to t
+		while (hufcoder.decode_chunk( sym )) {
+			for (auto s : sym) {
+				if (mtfrle0coder.count( s ) > t.size())
+					throw std::invalid_argument("encoded rle0-sequence is longer than text length");
+			}
+			i = mtfrle0coder.decode( sym.data(), sym.data() + sym.size(), t, i );
+		}
+		if (i != t.size())
+			throw std::invalid_argument("encoded rle0-sequence is shorter than text length");
+	}
+};
+
+//typedefs defining compressors
+typedef bwt_compressor<BW_SS_HUF> bwt_compressor_huf;
+typedef tbwt_compressor<BW_SS_HUF> tbwt_compressor_huf;
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * huffman-coder.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HUFFMAN_CODER_HPP
+#define _HUFFMAN_CODER_HPP
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+//! base class for semi-static huffman coding, bzip2-style.
+/*! symbols are coded in chunks. Each chunk is divided into groups of GROUP_SIZE
+  symbols, and each group is coded with one out of several canonical huffman tables,
+  which are optimized for the chunk. The index of the table used for a group
+  (the selector) is stored in front of the codes.
+  Encoding of a chunk: flag (1 byte, 1 for chunk, 0 for end), number of symbols (4 bytes),
+  length of the bit stream (4 bytes), and the bit stream itself, consisting of
+  number of tables (3 bits), code lengths (4 bits per table and symbol),
+  MTF + unary coded selectors and finally the codes.
+ */
+class huffman_coder {
+	public:
+		typedef uint16_t symbol_type;
+
+		//! maximal length of a code
+		static const unsigned MAX_CODE_LENGTH = 15;
+		//! number of symbols coded with the same table
+		static const unsigned GROUP_SIZE = 50;
+		//! maximal number of tables per chunk
+		static const unsigned MAX_TABLES = 6;
+		//! maximal number of symbols per chunk
+		static const uint32_t MAX_CHUNK_SYMBOLS = 1u << 22;
+	protected:
+		uint32_t sigma; //alphabet size
+
+		//computes code lengths for the given frequencies, limited to MAX_CODE_LENGTH.
+		// frequencies must be nonzero.
+		static void compute_code_lengths( std::vector<uint32_t> freq, std::vector<uint8_t> &len ) {
+			uint32_t n = freq.size();
+			len.assign( n, 0 );
+			if (n == 1) {
+				len[0] = 1;
+				return;
+			}
+			while (true) {
+				typedef std::pair<uint64_t,uint32_t> node; //weight and id
+				std::priority_queue<node, std::vector<node>, std::greater<node>> q;
+				std::vector<uint32_t> parent( 2*n - 1 );
+				for (uint32_t s = 0; s < n; s++)	q.push( node( freq[s], s ) );
+				for (uint32_t id = n; q.size() > 1; id++) {
+					node a = q.top(); q.pop();
+					node b = q.top(); q.pop();
+					parent[a.second] = parent[b.second] = id;
+					q.push( node( a.first + b.first, id ) );
+				}
+				//compute depths (parents always have bigger ids than their children)
+				std::vector<uint8_t> depth( 2*n - 1 );
+				bool ok = true;
+				for (uint32_t id = 2*n - 2; id-- > 0; ) {
+					depth[id] = depth[parent[id]] + 1;
+					if (id < n && depth[id] > MAX_CODE_LENGTH)	ok = false;
+				}
+				if (ok) {
+					std::copy( depth.begin(), depth.begin() + n, len.begin() );
+					return;
+				}
+				//flatten frequencies and retry
+				for (auto &f : freq)	f = 1 + f / 2;
+			}
+		};
+
+		//computes canonical codes from code lengths
+		static void compute_codes( const std::vector<uint8_t> &len, std::vector<uint16_t> &code ) {
+			code.assign( len.size(), 0 );
+			uint32_t c = 0;
+			for (unsigned l = 1; l <= MAX_CODE_LENGTH; l++) {
+				for (uint32_t s = 0; s < len.size(); s++) {
+					if (len[s] == l)	code[s] = c++;
+				}
+				c <<= 1;
+			}
+		};
+
+		//returns the number of tables used for a chunk of n symbols
+		static unsigned tables_for( uint32_t n ) {
+			return (n < 200) ? 1 : (n < 600) ? 2 : (n < 1200) ? 3 : (n < 2400) ? 4 : (n < 4800) ? 5 : 6;
+		};
+
+	public:
+		//! constructor, expects the alphabet size of the symbols to be coded.
+		huffman_coder( uint32_t sgm ) : sigma( sgm ) {
+			if (sigma == 0 || sigma > (1u << 16))
+				throw std::invalid_argument("invalid alphabet size for huffman coding");
+		};
+
+		//! returns sigma (alphabet size) of this coder.
+		uint32_t get_sigma() const {
+			return sigma;
+		};
+};
+
+//! class for semi-static huffman encoding.
+/*! class guarantees that ostream_t only has to support operations put and write.
+ */
+template<class ostream_t>
+class huffman_encoder : public huffman_coder {
+	private:
+		ostream_t &out;
+
+		//msb-first bit writer to a byte buffer
+		std::vector<uint8_t> buf;
+		uint64_t acc = 0;
+		unsigned cnt = 0;
+
+		void put_bits( uint32_t bits, unsigned n ) {
+			acc = (acc << n) | bits;
+			cnt += n;
+			while (cnt >= 8) {
+				cnt -= 8;
+				buf.push_back( (uint8_t)(acc >> cnt) );
+			}
+		};
+
+		void put_uint32( uint32_t v ) {
+			for (unsigned i = 0; i < 4; i++, v >>= 8)	out.put( (char)(v & 0xFFu) );
+		};
+	public:
+		//! constructor, expects a stream and the alphabet size.
+		huffman_encoder( ostream_t &s, uint32_t sgm ) : huffman_coder( sgm ), out( s ) {};
+
+		//! encodes the symbols in [first..last) as a chunk. Each symbol must be in [0..sigma-1].
+		/*! passes through exceptions from the underlying stream.
+		 */
+		void encode_chunk( const symbol_type *first, const symbol_type *last ) {
+			uint32_t n = last - first;
+			if (n == 0)	return;
+			if (n > MAX_CHUNK_SYMBOLS)
+				throw std::invalid_argument("huffman chunk is too long");
+			uint32_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+			unsigned nt = tables_for( n );
+
+			//initial tables: partition symbols into ranges of about equal frequencies
+			std::vector<uint32_t> total( sigma );
+			for (auto p = first; p != last; ++p)	++total[*p];
+			std::vector<std::vector<uint8_t>> len( nt, std::vector<uint8_t>( sigma, MAX_CODE_LENGTH ) );
+			uint32_t s = 0;
+			uint64_t remaining = n;
+			for (unsigned t = 0; t < nt; t++) {
+				uint64_t target = remaining / (nt - t), acc_f = 0;
+				while (s < sigma && (acc_f < target || t == nt-1)) {
+					acc_f += total[s];
+					len[t][s++] = 0;
+				}
+				remaining -= acc_f;
+			}
+
+			//refine tables iteratively
+			std::vector<uint8_t> sel( groups );
+			for (unsigned it = 0; it < 4; it++) {
+				std::vector<std::vector<uint32_t>> freq( nt, std::vector<uint32_t>( sigma, 1 ) );
+				for (uint32_t g = 0; g < groups; g++) {
+					auto gf = first + g * GROUP_SIZE;
+					auto gl = std::min( last, gf + GROUP_SIZE );
+					uint32_t bestcost = std::numeric_limits<uint32_t>::max();
+					for (unsigned t = 0; t < nt; t++) {
+						uint32_t cost = 0;
+						for (auto p = gf; p != gl; ++p)	cost += len[t][*p];
+						if (cost < bestcost) {
+							bestcost = cost;
+							sel[g] = t;
+						}
+					}
+					for (auto p = gf; p != gl; ++p)	++freq[sel[g]][*p];
+				}
+				for (unsigned t = 0; t < nt; t++)	compute_code_lengths( freq[t], len[t] );
+			}
+			std::vector<std::vector<uint16_t>> code( nt );
+			for (unsigned t = 0; t < nt; t++)	compute_codes( len[t], code[t] );
+
+			//write tables and selectors
+			buf.clear(); acc = 0; cnt = 0;
+			put_bits( nt - 1, 3 );
+			for (unsigned t = 0; t < nt; t++) {
+				for (uint32_t c = 0; c < sigma; c++)	put_bits( len[t][c], 4 );
+			}
+			uint8_t mtf[MAX_TABLES];
+			for (unsigned t = 0; t < MAX_TABLES; t++)	mtf[t] = t;
+			for (uint32_t g = 0; g < groups; g++) {
+				unsigned j = 0;
+				while (mtf[j] != sel[g])	++j;
+				for (unsigned k = j; k > 0; k--)	mtf[k] = mtf[k-1];
+				mtf[0] = sel[g];
+				put_bits( ((1u << j) - 1) << 1, j + 1 ); //j ones, followed by a zero
+			}
+
+			//write codes
+			for (uint32_t g = 0; g < groups; g++) {
+				const auto &c = code[sel[g]];
+				const auto &l = len[sel[g]];
+				auto gl = std::min( last, first + (g+1) * GROUP_SIZE );
+				for (auto p = first + g * GROUP_SIZE; p != gl; ++p)	put_bits( c[*p], l[*p] );
+			}
+			if (cnt > 0)	buf.push_back( (uint8_t)(acc << (8 - cnt)) );
+
+			//write chunk
+			out.put( 1 );
+			put_uint32( n );
+			put_uint32( buf.size() );
+			out.write( (const char *)buf.data(), buf.size() );
+		};
+
+		//! finishes encoding by writing an end marker.
+		void finish() {
+			out.put( 0 );
+		};
+};
+
+//! class for semi-static huffman decoding.
+/*! class guarantees that istream_t only has to support operations get and read.
+ */
+template<class istream_t>
+class huffman_decoder : public huffman_coder {
+	private:
+		//number of bits resolved by a table lookup
+		static const unsigned LOOKUP_BITS = 10;
+
+		//entry of a lookup table, containing up to two symbols
+		struct entry {
+			symbol_type s1;
+			symbol_type s2;
+			uint8_t n;    //number of symbols, 0 if code is longer than LOOKUP_BITS
+			uint8_t bits; //number of bits used by the symbols
+		};
+
+		//decoding information for a table
+		struct table {
+			std::vector<entry> single; //lookup for one symbol
+			std::vector<entry> dual;   //lookup for up to two symbols
+			uint32_t first[MAX_CODE_LENGTH+1]; //first canonical code of each length
+			uint32_t count[MAX_CODE_LENGTH+1]; //number of codes of each length
+			uint32_t offset[MAX_CODE_LENGTH+1]; //offset of each length in perm
+			std::vector<symbol_type> perm; //symbols sorted by code
+		};
+
+		istream_t &in;
+		std::vector<uint8_t> buf;
+		std::vector<table> tables;
+
+		//msb-first bit reader
+		const uint8_t *p;
+		const uint8_t *e;
+		uint64_t bb;
+		unsigned bc;
+
+		void refill() {
+			while (bc <= 56) {
+				bb |= (uint64_t)((p < e) ? *p : 0) << (56 - bc);
+				++p;
+				bc += 8;
+			}
+		};
+		uint32_t peek( unsigned n ) const {
+			return (uint32_t)(bb >> (64 - n));
+		};
+		void consume( unsigned n ) {
+			bb <<= n;
+			bc -= n;
+		};
+		uint32_t get_bits( unsigned n ) {
+			refill();
+			uint32_t v = peek( n );
+			consume( n );
+			return v;
+		};
+
+		uint32_t get_uint32() {
+			uint32_t v = 0;
+			for (unsigned i = 0; i < 4; i++)	v |= (uint32_t)(uint8_t)in.get() << (8*i);
+			return v;
+		};
+
+		//builds decoding information of table tb from code lengths
+		void build_table( table &tb, const std::vector<uint8_t> &len ) {
+			std::vector<uint16_t> code;
+			compute_codes( len, code );
+			//check code for validity (kraft inequality)
+			uint64_t kraft = 0;
+			for (auto l : len) {
+				if (l == 0)	throw std::invalid_argument("invalid huffman code length");
+				kraft += (uint64_t)1 << (MAX_CODE_LENGTH - l);
+			}
+			if (kraft > ((uint64_t)1 << MAX_CODE_LENGTH))
+				throw std::invalid_argument("invalid huffman code");
+
+			//slow path information
+			tb.perm.clear();
+			uint32_t c = 0;
+			for (unsigned l = 1; l <= MAX_CODE_LENGTH; l++) {
+				tb.first[l] = c;
+				tb.offset[l] = tb.perm.size();
+				for (uint32_t s = 0; s < len.size(); s++) {
+					if (len[s] == l)	tb.perm.push_back( s );
+				}
+				tb.count[l] = tb.perm.size() - tb.offset[l];
+				c = (c + tb.count[l]) << 1;
+			}
+
+			//single symbol lookup
+			tb.single.assign( 1u << LOOKUP_BITS, entry{ 0, 0, 0, 0 } );
+			for (uint32_t s = 0; s < len.size(); s++) {
+				if (len[s] <= LOOKUP_BITS) {
+					uint32_t lo = (uint32_t)code[s] << (LOOKUP_BITS - len[s]);
+					uint32_t hi = (uint32_t)(code[s] + 1) << (LOOKUP_BITS - len[s]);
+					for (uint32_t i = lo; i < hi; i++)	tb.single[i] = entry{ (symbol_type)s, 0, 1, len[s] };
+				}
+			}
+			//dual symbol lookup
+			tb.dual = tb.single;
+			for (uint32_t i = 0; i < tb.dual.size(); i++) {
+				entry &d = tb.dual[i];
+				if (d.n == 1 && d.bits < LOOKUP_BITS) {
+					const entry &d2 = tb.single[(i << d.bits) & ((1u << LOOKUP_BITS) - 1)];
+					if (d2.n == 1 && d.bits + d2.bits <= LOOKUP_BITS) {
+						d.s2 = d2.s1;
+						d.n = 2;
+						d.bits += d2.bits;
+					}
+				}
+			}
+		};
+
+		//decodes a symbol with a code longer than LOOKUP_BITS
+		symbol_type decode_slow( const table &tb ) {
+			uint32_t v = peek( MAX_CODE_LENGTH );
+			for (unsigned l = LOOKUP_BITS+1; l <= MAX_CODE_LENGTH; l++) {
+				uint32_t c = v >> (MAX_CODE_LENGTH - l);
+				if (c - tb.first[l] < tb.count[l]) {
+					consume( l );
+					return tb.perm[tb.offset[l] + c - tb.first[l]];
+				}
+			}
+			throw std::invalid_argument("invalid huffman code");
+		};
+
+	public:
+		//! constructor, expects a stream and the alphabet size.
+		huffman_decoder( istream_t &s, uint32_t sgm ) : huffman_coder( sgm ), in( s ) {};
+
+		//! decodes the next chunk and stores its symbols in out.
+		/*! returns false if no chunk is left. Throws an invalid_argument
+		  if the encoding is invalid.
+		 */
+		bool decode_chunk( std::vector<symbol_type> &out ) {
+			if (in.get() == 0)	return false;
+			uint32_t n = get_uint32();
+			uint32_t nbytes = get_uint32();
+			if (n == 0 || n > MAX_CHUNK_SYMBOLS || nbytes > 2u * n + sigma * MAX_TABLES + n / GROUP_SIZE + 16u)
+				throw std::invalid_argument("invalid huffman chunk");
+			buf.resize( nbytes );
+			in.read( (char *)buf.data(), nbytes );
+			p = buf.data(); e = p + nbytes; bb = 0; bc = 0;
+
+			//read tables
+			unsigned nt = get_bits( 3 ) + 1;
+			if (nt > MAX_TABLES)	throw std::invalid_argument("invalid huffman chunk");
+			tables.resize( nt );
+			std::vector<uint8_t> len( sigma );
+			for (unsigned t = 0; t < nt; t++) {
+				for (uint32_t c = 0; c < sigma; c++)	len[c] = get_bits( 4 );
+				build_table( tables[t], len );
+			}
+			//read selectors
+			uint32_t groups = (n + GROUP_SIZE - 1) / GROUP_SIZE;
+			std::vector<uint8_t> sel( groups );
+			uint8_t mtf[MAX_TABLES];
+			for (unsigned t = 0; t < MAX_TABLES; t++)	mtf[t] = t;
+			for (uint32_t g = 0; g < groups; g++) {
+				unsigned j = 0;
+				while (get_bits( 1 ))	if (++j >= nt)	throw std::invalid_argument("invalid huffman selector");
+				uint8_t t = mtf[j];
+				for (unsigned k = j; k > 0; k--)	mtf[k] = mtf[k-1];
+				mtf[0] = sel[g] = t;
+			}
+
+			//decode symbols
+			out.resize( n );
+			symbol_type *o = out.data();
+			for (uint32_t g = 0; g < groups; g++) {
+				const table &tb = tables[sel[g]];
+				uint32_t left = std::min( (uint32_t)GROUP_SIZE, n - g * GROUP_SIZE );
+				while (left >= 2) {
+					refill();
+					const entry &d = tb.dual[peek( LOOKUP_BITS )];
+					if (d.n == 0) {
+						*(o++) = decode_slow( tb );
+						--left;
+					} else {
+						consume( d.bits );
+						*(o++) = d.s1;
+						if (d.n == 2)	*(o++) = d.s2;
+						left -= d.n;
+					}
+				}
+				if (left == 1) {
+					refill();
+					const entry &d = tb.single[peek( LOOKUP_BITS )];
+					if (d.n == 0) {
+						*(o++) = decode_slow( tb );
+					} else {
+						consume( d.bits );
+						*(o++) = d.s1;
+					}
+				}
+			}
+			//check that no bits behind the buffer were used
+			if (p - e > (long)(bc / 8))
+				throw std::invalid_argument("huffman chunk is too short");
+			return true;
+		};
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * huge-page-allocator.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _HUGE_PAGE_ALLOCATOR_HPP
+#define _HUGE_PAGE_ALLOCATOR_HPP
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#if defined(__linux__)
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+//! namespace gathering the allocation policy for big, randomly accessed arrays.
+/*! allocations of at least HUGE_PAGE_SIZE bytes are mapped directly and backed
+   by transparent or explicit huge pages, optionally interleaved or bound across
+   NUMA nodes. If a policy is not available, allocation falls back silently to the
+   next weaker one, the policies really used can be queried with used().
+   Smaller allocations are served by operator new. All allocated bytes are tracked,
+   see allocated and peak_tracker.
+*/
+namespace memory_policy {
+	//! page policies
+	enum pages_t { STANDARD_PAGES = 0, TRANSPARENT_HUGE_PAGES = 1, EXPLICIT_HUGE_PAGES = 2 };
+	//! NUMA policies
+	enum numa_t { NUMA_DEFAULT = 0, NUMA_INTERLEAVE = 1, NUMA_BIND = 2 };
+
+	//! size of a huge page, also minimal size of allocations following the policy
+	const size_t HUGE_PAGE_SIZE = (size_t)2 << 20;
+
+	//configured and used policies (bit pages + 4*numa of used is set once the policy was used)
+	struct _state {
+		pages_t pages = TRANSPARENT_HUGE_PAGES;
+		numa_t numa = NUMA_DEFAULT;
+		unsigned node = 0;
+		std::atomic<unsigned> used{ 0 };
+		std::atomic<size_t> allocated{ 0 }; //bytes currently allocated
+	};
+	inline _state &_get_state() {
+		static _state s;
+		return s;
+	};
+
+	//! sets the policy for future allocations (node is only used for NUMA_BIND).
+	inline void set( pages_t pages, numa_t numa = NUMA_DEFAULT, unsigned node = 0 ) {
+		_state &s = _get_state();
+		s.pages = pages;
+		s.numa = numa;
+		s.node = node;
+	};
+
+	//! returns a description of all policies used by policy-following allocations so far.
+	/*! policies are accumulated over all threads, such that concurrent allocations
+	   (falling back to different policies) are all reported.
+	 */
+	inline std::string used() {
+		unsigned u = _get_state().used.load();
+		if (u == 0)	return "none";
+		static const char *pages[] = { "standard pages", "transparent huge pages", "explicit huge pages" };
+		static const char *numa[] = { "", ", numa interleave", ", numa bind" };
+		std::string d;
+		for (unsigned i = 0; i < 12; i++) {
+			if ((u & (1u << i)) == 0 || (i & 3) == 3)	continue;
+			d += (d.empty() ? "" : " and ") + std::string( pages[i & 3] ) + numa[i >> 2];
+		}
+		return d;
+	};
+
+	//! returns the number of bytes currently allocated by allocate.
+	inline size_t allocated() {
+		return _get_state().allocated.load();
+	};
+
+	//! tracks the peak of bytes allocated by the threads adopting it (see adopt).
+	/*! a tracker counts the bytes allocated minus the bytes freed by adopting threads,
+	   so its peak is the maximal number of bytes allocated on top of those allocated at
+	   its construction, unaffected by threads adopting other trackers. Changes are passed
+	   on to the tracker adopted when it was constructed, such that nested scopes see the
+	   peaks of their inner scopes.
+	 */
+	class peak_tracker {
+		private:
+			peak_tracker *const parent;
+			std::atomic<int64_t> current{ 0 }; //bytes allocated minus bytes freed
+			std::atomic<int64_t> max{ 0 }; //maximal value of current
+		public:
+			//! constructor, the tracker is not adopted by the current thread yet.
+			peak_tracker();
+
+			//! adds bytes (which are negative if freed) to this and all enclosing trackers.
+			void add( int64_t bytes ) {
+				for (peak_tracker *t = this; t != nullptr; t = t->parent) {
+					int64_t c = t->current.fetch_add( bytes ) + bytes;
+					int64_t m = t->max.load();
+					while (m < c && !t->max.compare_exchange_weak( m, c ));
+				}
+			};
+
+			//! returns the maximal number of bytes allocated at once since construction.
+			size_t peak() const {
+				return (size_t)max.load();
+			};
+	};
+
+	//tracker adopted by the current thread
+	inline peak_tracker *&_tracker() {
+		static thread_local peak_tracker *t = nullptr;
+		return t;
+	};
+
+	//! returns the tracker adopted by the current thread, or nullptr if none.
+	inline peak_tracker *tracker() {
+		return _tracker();
+	};
+
+	//! lets the current thread adopt tracker t (or none if t is nullptr), returns the tracker
+	//! adopted before. Threads started within a tracked scope should adopt its tracker.
+	inline peak_tracker *adopt( peak_tracker *t ) {
+		peak_tracker *prev = _tracker();
+		_tracker() = t;
+		return prev;
+	};
+
+	inline peak_tracker::peak_tracker() : parent( tracker() ) {};
+
+	//tracks allocated (or freed, if bytes is negative) bytes
+	inline void _track_allocation( int64_t bytes ) {
+		_get_state().allocated.fetch_add( bytes );
+		if (_tracker() != nullptr)	_tracker()->add( bytes );
+	};
+
+	//allocates bytes of memory following the policy, without tracking
+	inline void *_allocate( size_t bytes ) {
+#if defined(__linux__)
+		if (bytes < HUGE_PAGE_SIZE)	return ::operator new( bytes );
+		const _state &s = _get_state();
+		size_t len = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+		void *p = MAP_FAILED;
+		int pages = STANDARD_PAGES, numa = NUMA_DEFAULT;
+	#if defined(MAP_HUGETLB)
+		if (s.pages == EXPLICIT_HUGE_PAGES) {
+			p = mmap( NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+			if (p != MAP_FAILED)	pages = EXPLICIT_HUGE_PAGES;
+		}
+	#endif
+		if (p == MAP_FAILED) {
+			//map an additional huge page, such that the mapping can be aligned to huge pages
+			char *q = (char *)mmap( NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if (q == (char *)MAP_FAILED)	throw std::bad_alloc();
+			char *a = (char *)(((uintptr_t)q + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+			if (a != q)	munmap( q, a - q );
+			if (a + len != q + len + HUGE_PAGE_SIZE)	munmap( a + len, (q + HUGE_PAGE_SIZE) - a );
+			p = a;
+	#if defined(MADV_HUGEPAGE)
+			if (s.pages != STANDARD_PAGES && madvise( p, len, MADV_HUGEPAGE ) == 0)	pages = TRANSPARENT_HUGE_PAGES;
+	#endif
+		}
+	#if defined(SYS_mbind)
+		if (s.numa != NUMA_DEFAULT && (s.numa == NUMA_INTERLEAVE || s.node < 64)) {
+			const int MPOL_BIND_ = 2, MPOL_INTERLEAVE_ = 3; //see linux/mempolicy.h
+			unsigned long mask = (s.numa == NUMA_INTERLEAVE) ? ~0ul : 1ul << s.node;
+			if (syscall( SYS_mbind, p, len, (s.numa == NUMA_INTERLEAVE) ? MPOL_INTERLEAVE_ : MPOL_BIND_,
+			             &mask, (unsigned long)(8 * sizeof(mask) + 1), 0 ) == 0) {
+				numa = s.numa;
+			}
+		}
+	#endif
+		_get_state().used.fetch_or( 1u << (pages + 4 * numa) );
+		return p;
+#else
+		return ::operator new( bytes );
+#endif
+	};
+
+	//! allocates bytes of memory, throws a bad_alloc if this fails.
+	inline void *allocate( size_t bytes ) {
+		void *p = _allocate( bytes );
+		_track_allocation( (int64_t)bytes );
+		return p;
+	};
+
+	//! frees memory allocated by allocate with the same number of bytes.
+	inline void deallocate( void *p, size_t bytes ) noexcept {
+		_track_allocation( -(int64_t)bytes );
+#if defined(__linux__)
+		if (bytes >= HUGE_PAGE_SIZE) {
+			munmap( p, (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1) );
+			return;
+		}
+#endif
+		(void)bytes;
+		::operator delete( p );
+	};
+};
+
+//! an allocator for standard containers, which allocates memory following memory_policy.
+template<class T>
+class huge_page_allocator {
+	public:
+		typedef T value_type;
+
+		huge_page_allocator() noexcept {};
+		template<class U>
+		huge_page_allocator( const huge_page_allocator<U> & ) noexcept {};
+
+		T *allocate( size_t n ) {
+			return (T *)memory_policy::allocate( n * sizeof(T) );
+		};
+		void deallocate( T *p, size_t n ) noexcept {
+			memory_policy::deallocate( p, n * sizeof(T) );
+		};
+
+		template<class U>
+		struct rebind {
+			typedef huge_page_allocator<U> other;
+		};
+};
+
+template<class T, class U>
+bool operator==( const huge_page_allocator<T> &, const huge_page_allocator<U> & ) {
+	return true;
+}
+template<class T, class U>
+bool operator!=( const huge_page_allocator<T> &, const huge_page_allocator<U> & ) {
+	return false;
+}
+
+#endif
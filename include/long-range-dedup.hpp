@@ -0,0 +1,163 @@
+/*
+ * long-range-dedup.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _LONG_RANGE_DEDUP_HPP
+#define _LONG_RANGE_DEDUP_HPP
+
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+//! reversible removal of long repeats from a text, similar to srep.
+/*! repeats are found using a rolling hash over windows of WINDOW characters. Hashes
+   are stored for windows starting at multiples of WINDOW, which ensures that each
+   repeat of length at least 2*WINDOW is found. Found repeats are extended in both
+   directions and removed if they are at least MIN_MATCH characters long.
+   The removed repeats are described by a side stream of varint coded triples
+   (literal length, match distance, match length), preceded by the number of triples.
+ */
+class long_range_dedup {
+	public:
+		//! length of hashed windows
+		static const size_t WINDOW = 128;
+		//! minimal length of removed repeats
+		static const size_t MIN_MATCH = 2 * WINDOW;
+	private:
+		static const uint64_t BASE = 0x100000001B3ull;
+
+		struct match {
+			size_t pos;  //start position of the repeat
+			size_t dist; //distance to its previous occurrence
+			size_t len;  //length of the repeat
+		};
+
+		static void put_varint( std::string &s, uint64_t v ) {
+			for (; v >= 0x80u; v >>= 7)	s.push_back( (char)(v | 0x80u) );
+			s.push_back( (char)v );
+		};
+		static uint64_t get_varint( const std::string &s, size_t &p ) {
+			uint64_t v = 0;
+			for (unsigned shift = 0; ; shift += 7) {
+				if (p >= s.size() || shift > 63)	throw std::invalid_argument("invalid deduplication stream");
+				uint8_t b = s[p++];
+				v |= (uint64_t)(b & 0x7Fu) << shift;
+				if (b < 0x80u)	return v;
+			}
+		};
+
+		static uint64_t hash( const uint8_t *s ) {
+			uint64_t h = 0;
+			for (size_t i = 0; i < WINDOW; i++)	h = h * BASE + s[i];
+			return h;
+		};
+	public:
+		//! removes long repeats from t and returns the side stream needed to restore them.
+		/*! if no repeats are found, t stays unchanged and the side stream is empty.
+		 */
+		template<class string_t>
+		static std::string reduce( string_t &t ) {
+			const uint8_t *s = (const uint8_t *)t.data();
+			size_t n = t.size();
+			std::string side;
+			if (n < MIN_MATCH)	return side;
+
+			//hash table storing window positions (+1, zero means empty)
+			size_t bits = 10;
+			while (((size_t)1 << bits) < 2 * (n / WINDOW))	++bits;
+			std::vector<uint32_t> table( (size_t)1 << bits );
+			const size_t mask = table.size() - 1;
+			uint64_t bpow = 1; //BASE^WINDOW
+			for (size_t i = 0; i < WINDOW; i++)	bpow *= BASE;
+
+			//find repeats
+			std::vector<match> matches;
+			size_t lit = 0; //start of current literal run
+			size_t i = 0;
+			uint64_t h = hash( s );
+			while (i + WINDOW <= n) {
+				size_t slot = (h ^ (h >> 29)) & mask;
+				size_t c = table[slot];
+				if (c != 0 && --c < i && memcmp( s + c, s + i, WINDOW ) == 0) {
+					size_t len = WINDOW, back = 0;
+					while (i + len < n && s[c+len] == s[i+len])	++len;
+					while (back < i - lit && back < c && s[c-back-1] == s[i-back-1])	++back;
+					if (len + back >= MIN_MATCH) {
+						matches.push_back( match{ i - back, i - c, len + back } );
+						i += len;
+						lit = i;
+						if (i + WINDOW <= n)	h = hash( s + i );
+						continue;
+					}
+				}
+				if (i % WINDOW == 0)	table[slot] = i + 1;
+				if (i + WINDOW < n)	h = h * BASE + s[i+WINDOW] - s[i] * bpow;
+				++i;
+			}
+			if (matches.empty())	return side;
+
+			//write side stream and remove repeats from t
+			put_varint( side, matches.size() );
+			size_t r = 0, w = 0; //read and write position
+			for (auto &m : matches) {
+				put_varint( side, m.pos - r );
+				put_varint( side, m.dist );
+				put_varint( side, m.len );
+				memmove( &t[w], &t[r], m.pos - r );
+				w += m.pos - r;
+				r = m.pos + m.len;
+			}
+			memmove( &t[w], &t[r], n - r );
+			t.resize( w + n - r );
+			return side;
+		};
+
+		//! restores the text from the reduced text r and the side stream, and appends it to t.
+		/*! throws an invalid_argument if the side stream is invalid, or if the restored
+		   text would be longer than max_size.
+		 */
+		template<class string_t>
+		static void expand( const std::string &r, const std::string &side, size_t max_size, string_t &t ) {
+			size_t p = 0, rp = 0;
+			uint64_t cnt = get_varint( side, p );
+			if (cnt > side.size())	throw std::invalid_argument("invalid deduplication stream");
+			for (uint64_t k = 0; k < cnt; k++) {
+				uint64_t l = get_varint( side, p );
+				uint64_t d = get_varint( side, p );
+				uint64_t m = get_varint( side, p );
+				if (l > r.size() - rp || d == 0 || d > t.size() + l || m > max_size || t.size() + l + m > max_size)
+					throw std::invalid_argument("invalid deduplication stream");
+				t.insert( t.end(), r.begin() + rp, r.begin() + rp + l );
+				rp += l;
+				size_t o = t.size();
+				t.resize( o + m );
+				for (size_t j = o; j < o + m; j++)	t[j] = t[j - d]; //repeats may overlap
+			}
+			if (p != side.size() || t.size() + (r.size() - rp) > max_size)
+				throw std::invalid_argument("invalid deduplication stream");
+			t.insert( t.end(), r.begin() + rp, r.end() );
+		};
+};
+
+#endif
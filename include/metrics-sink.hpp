@@ -0,0 +1,148 @@
+/*
+ * metrics-sink.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _METRICS_SINK_HPP
+#define _METRICS_SINK_HPP
+
+#include <mutex>
+#include <ostream>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+//! a metric recorded during compression or decompression of a block.
+struct metric_record {
+	//! types of metrics
+	enum type_t { DURATION, BYTES, COUNT, MEMORY, TEXT };
+
+	int64_t block; //!< index of the block in the input, -1 for metrics of the whole input
+	std::string stage; //!< stage of the block (read, transform, encode, decode or transcode), empty if none
+	std::string key; //!< name of the metric
+	type_t type; //!< type of the metric
+	int64_t value; //!< value of numeric metrics, durations are given in nanoseconds, sizes in bytes
+	std::string text; //!< value of TEXT metrics
+
+	//! returns the name of a metric type
+	static const char *type_name( type_t t ) {
+		static const char *names[] = { "duration", "bytes", "count", "memory", "text" };
+		return names[t];
+	};
+};
+
+//! interface of a receiver of metrics, see block_compressor::set_metrics_sink.
+/*! Note that compressors may run stages of different blocks concurrently, so record
+   may be called by multiple threads at once.
+ */
+class metrics_sink {
+	public:
+		//! receives a metric
+		virtual void record( const metric_record &r ) = 0;
+		virtual ~metrics_sink() {};
+};
+
+//! a sink writing metrics human-readable, one metric per line.
+/*! each line has the format "> key\t\tvalue", where durations are written in milliseconds.
+ */
+class text_metrics_sink : public metrics_sink {
+	private:
+		std::ostream &out;
+		std::mutex out_mutex;
+	public:
+		//! constructor, metrics are written to o
+		text_metrics_sink( std::ostream &o ) : out( o ) {};
+
+		virtual void record( const metric_record &r ) {
+			std::lock_guard<std::mutex> lock( out_mutex );
+			out << "> " << r.key << "\t\t";
+			if (r.type == metric_record::TEXT)	out << r.text;
+			else if (r.type == metric_record::DURATION)	out << r.value / 1000000;
+			else	out << r.value;
+			out << std::endl;
+		};
+};
+
+//! a sink writing metrics as JSON lines, i.e. one JSON object per metric and line.
+/*! an object has the fields block, stage, key, type and value, where the value of
+   durations is given in nanoseconds.
+ */
+class json_metrics_sink : public metrics_sink {
+	private:
+		std::ostream &out;
+		std::mutex out_mutex;
+
+		static std::string escape( const std::string &s ) {
+			std::string e;
+			for (char c : s) {
+				if (c == '"' || c == '\\') {
+					e += '\\';
+					e += c;
+				} else if ((unsigned char)c < 0x20) {
+					char buf[8];
+					snprintf( buf, sizeof(buf), "\\u%04x", c );
+					e += buf;
+				} else {
+					e += c;
+				}
+			}
+			return e;
+		};
+	public:
+		//! constructor, metrics are written to o
+		json_metrics_sink( std::ostream &o ) : out( o ) {};
+
+		virtual void record( const metric_record &r ) {
+			std::lock_guard<std::mutex> lock( out_mutex );
+			out << "{\"block\": " << r.block << ", \"stage\": \"" << r.stage << "\", \"key\": \""
+			    << escape( r.key ) << "\", \"type\": \"" << metric_record::type_name( r.type ) << "\", \"value\": ";
+			if (r.type == metric_record::TEXT)	out << '"' << escape( r.text ) << '"';
+			else	out << r.value;
+			out << "}" << std::endl;
+		};
+};
+
+//! a sink collecting all metrics in memory, e.g. for library callers.
+class collecting_metrics_sink : public metrics_sink {
+	private:
+		std::vector<metric_record> m_records;
+		mutable std::mutex records_mutex;
+	public:
+		virtual void record( const metric_record &r ) {
+			std::lock_guard<std::mutex> lock( records_mutex );
+			m_records.push_back( r );
+		};
+
+		//! returns a copy of all metrics collected so far
+		std::vector<metric_record> records() const {
+			std::lock_guard<std::mutex> lock( records_mutex );
+			return m_records;
+		};
+
+		//! removes all metrics collected so far
+		void clear() {
+			std::lock_guard<std::mutex> lock( records_mutex );
+			m_records.clear();
+		};
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * mtf-rle0-coder.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MTF_RLE0_CODER_HPP
+#define _MTF_RLE0_CODER_HPP
+
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <vector>
+
+#include "rle0-coder.hpp"
+#include "twobitvector.hpp"
+
+//! fused Move-To-Front and RLE0 encoder, requires a string type.
+/*! the encoder produces exactly the symbols of an mtf_coder followed by an
+  rle0_encoder, but works on whole runs of the input: a run of length l
+  costs one MTF step, its remaining l-1 zeros are accumulated in a single
+  counter. Encoded symbols are appended to a contiguous buffer, such that
+  entropy coding can be done in a separate tight loop.
+ */
+template<class string_t>
+class mtf_rle0_encoder {
+	public:
+		typedef typename string_t::value_type char_type;
+		typedef typename string_t::size_type size_type;
+		typedef uint16_t symbol_type;
+	private:
+		static_assert( sizeof(char_type) == 1, "character type must be a byte type" );
+		uint8_t alph[std::numeric_limits<uint8_t>::max()+1];
+		size_type sigma;
+		size_type zeros = 0; //length of current zero-run
+
+		//appends the encoding of the current zero-run to out
+		void flush_zeros( std::vector<symbol_type> &out ) {
+			for (size_type zrl_p1 = zeros + 1; zrl_p1 != 1; zrl_p1 >>= 1) {
+				out.push_back( zrl_p1 & 1u );
+			}
+			zeros = 0;
+		};
+	public:
+		//! constructs an encoder, expects the alphabet of the underlying source (see mtf_coder::compute_alph).
+		mtf_rle0_encoder( const string_t &_alph ) : sigma( _alph.size() ) {
+			for (size_type i = 0; i < sigma; i++)	alph[i] = _alph[i];
+		};
+
+		//! encodes t[first..last) and appends the resulting symbols to out.
+		/*! the last zero-run is kept pending, so encoding can be continued by
+		  another call; use flush to write out the pending zero-run.
+		 */
+		void encode( const string_t &t, size_type first, size_type last, std::vector<symbol_type> &out ) {
+			for (size_type i = first; i < last; ) {
+				size_type e = rle0_detail::run_end( t, i, last );
+				uint8_t c = t[i];
+				if (alph[0] == c) { //rank zero, whole run is a zero-run
+					zeros += e - i;
+				} else {
+					//move c to front
+					size_type r = (const uint8_t *)memchr( alph, c, sigma ) - alph;
+					memmove( alph + 1, alph, r );
+					alph[0] = c;
+
+					flush_zeros( out );
+					out.push_back( (symbol_type)(r + 1) );
+					zeros = e - i - 1;
+				}
+				i = e;
+			}
+		};
+
+		//! appends the symbols of the pending zero-run to out.
+		void flush( std::vector<symbol_type> &out ) {
+			flush_zeros( out );
+		};
+};
+
+//! fused RLE0 and Move-To-Front decoder, inverse of mtf_rle0_encoder.
+template<class string_t>
+class mtf_rle0_decoder {
+	public:
+		typedef typename string_t::value_type char_type;
+		typedef typename string_t::size_type size_type;
+		typedef uint16_t symbol_type;
+	private:
+		static_assert( sizeof(char_type) == 1, "character type must be a byte type" );
+		uint8_t alph[std::numeric_limits<uint8_t>::max()+1];
+		size_type sigma;
+		size_type rll = 0; //length of current run-length-sequence
+		size_type z2write = 0; //number of zeros to write for current run
+		size_type decoded = 0; //number of characters accounted so far
+		size_type crll = 0; //length of current run-length-sequence while accounting
+
+		//writes v to t[first..last)
+		template<class S>
+		static void fill( S &t, size_type first, size_type last, uint8_t v ) {
+			for (size_type i = first; i < last; i++)	t[i] = v;
+		};
+		template<class A>
+		static void fill( std::vector<uint8_t,A> &t, size_type first, size_type last, uint8_t v ) {
+			memset( t.data() + first, v, last - first );
+		};
+		static void fill( twobitvector &t, size_type first, size_type last, uint8_t v ) {
+			t.fill( first, last, v );
+		};
+	public:
+		//! constructs a decoder, expects the alphabet used for encoding.
+		mtf_rle0_decoder( const string_t &_alph ) : sigma( _alph.size() ) {
+			if (sigma > std::numeric_limits<uint8_t>::max()+1u)
+				throw std::invalid_argument("MTF Retransform failed");
+			for (size_type i = 0; i < sigma; i++)	alph[i] = _alph[i];
+		};
+
+		//! accounts symbol c and returns the number of characters decoded so far
+		//! (including c), without actually decoding it (see decode).
+		size_type count( symbol_type c ) {
+			if (c <= 1u) { //run character
+				if (crll >= std::numeric_limits<size_type>::digits - 2)
+					throw std::invalid_argument("illegal value range in RLE0-decoding");
+				decoded += (size_type)1 << (c + crll++);
+			} else {
+				++decoded;
+				crll = 0;
+			}
+			return decoded;
+		};
+
+		//! decodes the symbols [first..last) and writes the result to t, starting at position i.
+		/*! symbols must have been accounted using count before. Returns the position behind
+		  the last written character. Throws invalid_argument if the symbols are out of range,
+		  or if the decoding is longer than t.
+		 */
+		size_type decode( const symbol_type *first, const symbol_type *last, string_t &t, size_type i ) {
+			for (; first != last; ++first) {
+				symbol_type c = *first;
+				if (c <= 1u) { //run character
+					z2write += (size_type)1 << (c + rll++);
+					continue;
+				}
+				rll = 0;
+				//write zero-run as a whole
+				if (z2write > t.size() - i)
+					throw std::invalid_argument("encoded rle0-sequence is longer than text length");
+				fill( t, i, i + z2write, alph[0] );
+				i += z2write;
+				z2write = 0;
+
+				//decode mtf-rank
+				size_type r = c - 1;
+				if (r >= sigma)
+					throw std::invalid_argument("MTF Retransform failed");
+				if (i >= t.size())
+					throw std::invalid_argument("encoded rle0-sequence is longer than text length");
+				uint8_t ch = alph[r];
+				memmove( alph + 1, alph, r );
+				alph[0] = ch;
+				t[i++] = ch;
+			}
+			//write trailing zero-run
+			if (z2write > t.size() - i)
+				throw std::invalid_argument("encoded rle0-sequence is longer than text length");
+			fill( t, i, i + z2write, alph[0] );
+			i += z2write;
+			z2write = 0;
+			return i;
+		};
+};
+
+#endif
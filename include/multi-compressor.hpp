@@ -0,0 +1,333 @@
+/*
+ * multi-compressor.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _MULTI_COMPRESSOR_HPP
+#define _MULTI_COMPRESSOR_HPP
+
+#include "block-compressor.hpp"
+#include "aux-coder.hpp"
+#include "block-scores-rle-model.hpp"
+#include "bwt-config.hpp"
+#include "bwt-run-support.hpp"
+#include "divsufsort.h"
+#include "tunneling-support.hpp"
+#include "twobitvector.hpp"
+
+#include <assert.h>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//! a block compressor choosing the method (compressor) of each block at runtime.
+/*! methods are registered using add_method. Each block is encoded by one method, and
+   its encoding starts with the tag of the method. In auto mode (default), the method
+   of a block is chosen by trial encodings of a sample of the block: among all methods
+   whose trial encoding is at most target() times as large as the smallest trial encoding,
+   the method with the smallest cost (given at registration) is chosen. Methods sharing
+   the (tunneled) bwt encode the transformed sample only, which is computed once, and
+   tunneled methods are skipped if no block of the sample is worth tunneling. So slow
+   methods are only chosen if they compress notably better, and the choice depends on
+   the text only (not on timings).
+ */
+class multi_compressor : public block_compressor {
+	public:
+		//! name of the auto mode
+		static constexpr const char *AUTO = "auto";
+	private:
+		//a registered method
+		struct method {
+			uint8_t tag; //tag of the method stored in front of each block
+			std::string name;
+			double cost; //relative time to compress and decompress a byte
+			std::unique_ptr<block_compressor> c; //compressor of the method
+			std::unique_ptr<block_compressor> trial; //quiet compressor for trial compressions
+		};
+
+		//state of a block, which keeps the state of the block's method
+		struct multi_block_state : public block_state {
+			const method *m = nullptr;
+			std::unique_ptr<block_state> sub;
+		};
+
+		//length of samples used for trial compressions, and number of sampled slices
+		static const size_t SAMPLE_LENGTH = 128*1024;
+		static const size_t SAMPLE_SLICES = 4;
+		static const size_t AUTO_METHOD = std::numeric_limits<size_t>::max();
+
+		std::vector<method> methods;
+		size_t fixed = AUTO_METHOD; //index of method used for all blocks, or AUTO_METHOD
+		double tolerance = 1.02; //see set_target
+
+		//chooses a method for text t using trial encodings of a sample
+		const method &choose( const text_t &t ) const {
+			//build sample of evenly distributed slices
+			std::string sample;
+			if (t.size() <= SAMPLE_LENGTH) {
+				sample.assign( t.begin(), t.end() );
+			} else {
+				const size_t slice = SAMPLE_LENGTH / SAMPLE_SLICES;
+				for (size_t k = 0; k < SAMPLE_SLICES; k++) {
+					auto first = t.begin() + k * (t.size() - slice) / (SAMPLE_SLICES - 1);
+					sample.append( first, first + slice );
+				}
+			}
+
+			//bwt of the sample, shared by all methods transforming the text by a (tunneled) bwt
+			text_t bwt( sample.begin(), sample.end() );
+			const t_size_t n = bwt.size();
+			std::vector<saidx_t> SA( n+1 );
+			saidx_t bwt_idx = divbwt( bwt.data(), bwt.data(), SA.data(), (saidx_t)n );
+			if (bwt_idx < 0) {
+				throw std::runtime_error("BW Transformation failed");
+			}
+
+			//tunnel the bwt as tunneled methods do, the choice of blocks is the same for all of them
+			text_t tbwt;
+			uint64_t auxsize = 0;
+			t_size_t tunnels = 0;
+			if (has_transformation( "tbwt" )) {
+				tbwt = bwt;
+				twobitvector aux;
+				t_idx_t tbwt_idx = 0;
+				{
+					bwt_run_support bwtrs( tbwt.data(), n, bwt_idx );
+					tunneling_support<block_scores_rle_model> ts( bwtrs );
+					std::vector<t_idx_t> H;
+					tunnels = ts.choose_blocks( H ).tunnel_cnt;
+					if (tunnels > 0) {
+						tbwt_idx = ts.tunnel_bwt( tbwt, aux, H.rbegin(), H.rbegin() + tunnels );
+					}
+				}
+				if (tunnels > 0) {
+					block_scores_rle_model::transform_aux( tbwt, tbwt_idx, aux );
+					std::ostringstream auxenc;
+					aux_coder::encode( aux, auxenc );
+					auxsize = auxenc.str().size();
+				}
+			}
+			record_count("trial tunneled block count", tunnels );
+
+			//estimate encoding sizes, methods without trial encoding are skipped
+			std::vector<uint64_t> sizes( methods.size() );
+			std::vector<bool> tried( methods.size(), false );
+			uint64_t best = std::numeric_limits<uint64_t>::max();
+			for (size_t i = 0; i < methods.size(); i++) {
+				auto &m = methods[i];
+				const std::string tr = m.trial->transformation();
+				std::ostringstream out;
+				out.exceptions( std::ostream::badbit );
+				uint64_t extra = 0; //size of encodings shared by methods
+				if (tr == "bwt") {
+					text_t s( bwt );
+					m.trial->encode_transformed( s, out );
+				} else if (tr == "tbwt" && tunnels > 0) {
+					text_t s( tbwt );
+					m.trial->encode_transformed( s, out );
+					extra = auxsize;
+				} else if (tr == "tbwt") {
+					continue; //tunneling does not pay, the method equals its untunneled variant
+				} else {
+					std::istringstream in( sample );
+					in.exceptions( std::istream::badbit | std::istream::eofbit );
+					delegate_compress_block( *m.trial, in, sample.size(), out );
+				}
+				sizes[i] = out.str().size() + extra;
+				tried[i] = true;
+				best = std::min( best, sizes[i] );
+			}
+
+			//choose cheapest method meeting the target, preferring smaller and earlier ones
+			size_t c = methods.size();
+			for (size_t i = 0; i < methods.size(); i++) {
+				if (!tried[i] || sizes[i] > best * tolerance)	continue;
+				if (c == methods.size() || methods[i].cost < methods[c].cost
+				    || (methods[i].cost == methods[c].cost && sizes[i] < sizes[c])) {
+					c = i;
+				}
+			}
+			if (c == methods.size()) {
+				throw std::logic_error("no method can be tried");
+			}
+			record_bytes("trial encoding size", sizes[c] );
+			record_bytes("trial encoding best size", best );
+			return methods[c];
+		};
+
+		//returns whether a registered method uses transformation tr
+		bool has_transformation( const std::string &tr ) const {
+			for (auto &m : methods) {
+				if (m.trial->transformation() == tr)	return true;
+			}
+			return false;
+		};
+
+		const method *find( uint8_t tag ) const {
+			for (auto &m : methods) {
+				if (m.tag == tag)	return &m;
+			}
+			return nullptr;
+		};
+	protected:
+		virtual void decompress_block( std::istream &in, std::streampos end, std::ostream &out ) const {
+			auto m = find( (uint8_t)in.get() );
+			if (m == nullptr) {
+				throw std::invalid_argument("invalid block method");
+			}
+			print_info("block method", m->name );
+			delegate_decompress_block( *m->c, in, end, out );
+		};
+
+		virtual std::unique_ptr<block_state> make_block_state() const {
+			return std::unique_ptr<block_state>( new multi_block_state() );
+		};
+
+		virtual void transform_block( block_state &bs ) const {
+			if (methods.empty()) {
+				throw std::logic_error("no methods registered");
+			}
+			auto &ms = static_cast<multi_block_state &>( bs );
+			ms.m = (fixed != AUTO_METHOD) ? &methods[fixed] : &choose( bs.data );
+			print_info("block method", ms.m->name );
+
+			//pass the block to the state of the chosen method
+			ms.sub = delegate_make_block_state( *ms.m->c );
+			ms.sub->ctx = bs.ctx;
+			ms.sub->data.swap( bs.data );
+			ms.sub->pos = bs.pos;
+			ms.sub->size = bs.size;
+			delegate_transform_block( *ms.m->c, *ms.sub );
+		};
+
+		virtual void encode_block( block_state &bs, std::ostream &out ) const {
+			auto &ms = static_cast<multi_block_state &>( bs );
+			out.put( (char)ms.m->tag );
+			delegate_encode_block( *ms.m->c, *ms.sub, out );
+			ms.sub.reset();
+		};
+	public:
+		//! constructor
+		multi_compressor() : block_compressor( t_max_size ) {};
+
+		//! registers a method with compressor type C, a unique tag and a unique name.
+		/*! cost is the relative time the method needs to compress and decompress a byte,
+		   the auto mode prefers methods with smaller costs. Encodings can be decompressed
+		   only if the same methods are registered with the same tags.
+		 */
+		template<class C>
+		void add_method( uint8_t tag, const std::string &name, double cost = 1.0 ) {
+			if (find( tag ) != nullptr || name == AUTO || has_method( name )) {
+				throw std::invalid_argument("method is registered already");
+			}
+			std::unique_ptr<block_compressor> c( new C() ), trial( new C() );
+			assert( c->get_max_block_size() >= get_max_block_size() );
+			c->set_quiet( is_quiet() );
+			c->set_metrics_sink( get_metrics_sink() );
+			c->set_perf_counters( get_perf_counters() );
+			c->set_threads( get_threads() );
+			c->set_memory_budget( get_memory_budget() );
+			c->set_scratch_dir( get_scratch_dir() );
+			methods.push_back( method{ tag, name, cost, std::move( c ), std::move( trial ) } );
+		};
+
+		//! returns whether a method with the given name is registered.
+		bool has_method( const std::string &name ) const {
+			for (auto &m : methods) {
+				if (m.name == name)	return true;
+			}
+			return false;
+		};
+
+		//! sets the method used for compression, which is either the name of a registered
+		//! method or AUTO (default). Throws an invalid_argument if no such method exists.
+		void set_method( const std::string &name ) {
+			fixed = AUTO_METHOD;
+			if (name == AUTO)	return;
+			for (size_t i = 0; i < methods.size(); i++) {
+				if (methods[i].name == name)	fixed = i;
+			}
+			if (fixed == AUTO_METHOD) {
+				throw std::invalid_argument("unknown method " + name);
+			}
+		};
+
+		//! sets the target of the auto mode (default 1.02), i.e. the maximal size of a trial
+		//! encoding relative to the smallest trial encoding for a method to be chosen.
+		void set_target( double t ) {
+			assert( t >= 1.0 );
+			tolerance = t;
+		};
+
+		//! returns the target of the auto mode (see set_target).
+		double target() const {
+			return tolerance;
+		};
+
+		//! returns the id of multi encodings, blocks identify their methods themselves.
+		virtual uint32_t format_id() const {
+			return 0x200;
+		};
+
+		//! sets the quiet state of this compressor and its methods (see block_compressor::set_quiet).
+		virtual void set_quiet( bool q ) {
+			block_compressor::set_quiet( q );
+			for (auto &m : methods)	m.c->set_quiet( q );
+		};
+
+		//! sets the metrics sink of this compressor and its methods (see block_compressor::set_metrics_sink).
+		virtual void set_metrics_sink( std::shared_ptr<metrics_sink> s ) {
+			block_compressor::set_metrics_sink( s );
+			for (auto &m : methods)	m.c->set_metrics_sink( s );
+		};
+
+		//! sets whether this compressor and its methods count hardware events (see block_compressor::set_perf_counters).
+		virtual void set_perf_counters( bool p ) {
+			block_compressor::set_perf_counters( p );
+			for (auto &m : methods)	m.c->set_perf_counters( p );
+		};
+
+		//! sets the number of threads of this compressor and its methods (see block_compressor::set_threads).
+		virtual void set_threads( unsigned t ) {
+			block_compressor::set_threads( t );
+			for (auto &m : methods)	m.c->set_threads( t );
+		};
+
+		//! sets the memory budget of this compressor and its methods (see block_compressor::set_memory_budget).
+		virtual void set_memory_budget( size_t bytes ) {
+			block_compressor::set_memory_budget( bytes );
+			for (auto &m : methods)	m.c->set_memory_budget( bytes );
+		};
+
+		//! sets the scratch directory of this compressor and its methods (see block_compressor::set_scratch_dir).
+		virtual void set_scratch_dir( const std::string &dir ) {
+			block_compressor::set_scratch_dir( dir );
+			for (auto &m : methods)	m.c->set_scratch_dir( dir );
+		};
+};
+
+#endif
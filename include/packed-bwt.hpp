@@ -0,0 +1,397 @@
+/*
+ * packed-bwt.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _PACKED_BWT_HPP
+#define _PACKED_BWT_HPP
+
+#include "aux-encoding.hpp"
+#include "bwt-config.hpp"
+#include "huge-page-allocator.hpp"
+#include "twobitvector.hpp"
+
+#include <array>
+#include <ostream>
+#include <stack>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__BMI2__)
+	#include <immintrin.h>
+#endif
+
+//! a bwt over a small alphabet of at most 2^t_bits characters, packed to t_bits bits per
+//! character (t_bits is 2 or 4), supporting access and rank in a single cache line.
+/*! the bwt is divided into lines of 64 bytes. Each line stores the number of occurences
+   of each character in front of the line (relative to its superblock), followed by the
+   packed characters of the line. Absolute counts are stored for superblocks of lines.
+ */
+template<unsigned t_bits>
+class packed_bwt {
+	static_assert( t_bits == 2 || t_bits == 4, "packed_bwt supports 2 or 4 bits per character" );
+	public:
+		//! number of possible characters
+		static const unsigned SIGMA = 1u << t_bits;
+	private:
+		static const unsigned WORDS = (64 - 2 * SIGMA) / 8; //words per line
+		static const unsigned WORD_ENTRIES = 64 / t_bits; //characters per word
+		static const unsigned LINE_ENTRIES = WORDS * WORD_ENTRIES; //characters per line
+		static const unsigned SUPER_LINES = 65536 / LINE_ENTRIES; //lines per superblock
+		static const uint64_t LO_BITS = (t_bits == 2) ? 0x5555555555555555ull : 0x1111111111111111ull;
+
+		struct line {
+			uint16_t cnt[SIGMA]; //occurences in front of line within superblock
+			uint64_t data[WORDS]; //packed characters
+		};
+		static_assert( sizeof(line) == 64, "lines must fill a cache line" );
+
+		std::vector<line, huge_page_allocator<line>> lines;
+		std::vector<std::array<t_size_t,SIGMA>> super; //occurences in front of superblock
+		t_size_t n;
+
+		//returns the lower bit of each entry of word w which is equal to c
+		static uint64_t match( uint64_t w, unsigned c ) {
+			w ^= LO_BITS * c;
+			if (t_bits == 4)	w |= w >> 2;
+			return ~(w | (w >> 1)) & LO_BITS;
+		};
+	public:
+		//! constructs the packed bwt of S, whose characters are mapped using code
+		//! (codes must be smaller than SIGMA).
+		packed_bwt( const t_string_t &S, const std::array<uint8_t,256> &code )
+		          : lines( (S.size() + LINE_ENTRIES - 1) / LINE_ENTRIES + 1 ),
+		            super( lines.size() / SUPER_LINES + 1 ), n( S.size() ) {
+			std::array<t_size_t,SIGMA> cnt{}; //absolute occurences
+			for (size_t l = 0; l < lines.size(); l++) {
+				if (l % SUPER_LINES == 0)	super[l / SUPER_LINES] = cnt;
+				for (unsigned c = 0; c < SIGMA; c++) {
+					lines[l].cnt[c] = cnt[c] - super[l / SUPER_LINES][c];
+				}
+				for (unsigned w = 0; w < WORDS; w++) {
+					uint64_t word = 0;
+					size_t first = (size_t)l * LINE_ENTRIES + w * WORD_ENTRIES;
+					for (unsigned k = 0; k < WORD_ENTRIES && first + k < n; k++) {
+						uint64_t c = code[S[first+k]];
+						word |= c << (k * t_bits);
+						++cnt[c];
+					}
+					lines[l].data[w] = word;
+				}
+			}
+		};
+
+		//! returns the length of the bwt.
+		t_size_t size() const {
+			return n;
+		};
+
+		//! returns the character at position i, and stores the number of its occurences
+		//! in front of i in rank.
+		unsigned access_rank( t_size_t i, t_size_t &rank ) const {
+			const line &ln = lines[i / LINE_ENTRIES];
+			unsigned o = i % LINE_ENTRIES, w = o / WORD_ENTRIES, k = o % WORD_ENTRIES;
+			unsigned c = (ln.data[w] >> (k * t_bits)) & (SIGMA - 1);
+			rank = super[i / LINE_ENTRIES / SUPER_LINES][c] + ln.cnt[c]
+			     + __builtin_popcountll( match( ln.data[w], c ) & ((1ull << (k * t_bits)) - 1) );
+			for (unsigned j = 0; j < w; j++) {
+				rank += __builtin_popcountll( match( ln.data[j], c ) );
+			}
+			return c;
+		};
+};
+
+//! a bitvector supporting rank, select and predecessor queries on its set bits.
+/*! bits are stored in lines of 64 bytes, each holding the number of set bits in front of
+   the line, followed by 448 bits. The line of every 256th set bit is sampled, so rank needs
+   a single cache line and select usually a sample and a single line.
+ */
+class rank_select_bits {
+	private:
+		static const unsigned WORDS = 7; //words per line
+		static const t_size_t LINE_BITS = 64 * WORDS;
+		static const t_size_t SAMPLE = 256; //set bits per sample
+
+		struct line {
+			uint64_t rank; //set bits in front of line
+			uint64_t bits[WORDS];
+		};
+		static_assert( sizeof(line) == 64, "lines must fill a cache line" );
+
+		std::vector<line, huge_page_allocator<line>> lines;
+		std::vector<t_size_t> samples; //line of every SAMPLE-th set bit
+	public:
+		//! constructs a bitvector of n bits, where bit i is set if bit( i ) is true.
+		template<class t_bit>
+		rank_select_bits( t_size_t n, t_bit bit ) : lines( n / LINE_BITS + 2 ) {
+			t_size_t ones = 0;
+			for (size_t l = 0; l < lines.size(); l++) {
+				lines[l].rank = ones;
+				for (unsigned w = 0; w < WORDS; w++) {
+					uint64_t word = 0;
+					t_size_t first = l * LINE_BITS + w * 64;
+					for (unsigned k = 0; k < 64 && first + k < n; k++) {
+						word |= (uint64_t)(bit( first + k ) ? 1 : 0) << k;
+					}
+					lines[l].bits[w] = word;
+					ones += __builtin_popcountll( word );
+				}
+				for (t_size_t k = samples.size() * SAMPLE; k < ones; k += SAMPLE) {
+					samples.push_back( l );
+				}
+			}
+		};
+
+		//! returns the number of set bits.
+		t_size_t ones() const {
+			return lines.back().rank;
+		};
+
+		//! returns bit i.
+		bool operator[]( t_size_t i ) const {
+			return (lines[i / LINE_BITS].bits[i % LINE_BITS / 64] >> (i % 64)) & 1;
+		};
+
+		//! returns the number of set bits in front of position i.
+		t_size_t rank( t_size_t i ) const {
+			const line &ln = lines[i / LINE_BITS];
+			unsigned w = i % LINE_BITS / 64;
+			t_size_t r = ln.rank + __builtin_popcountll( ln.bits[w] & ((1ull << (i % 64)) - 1) );
+			for (unsigned v = 0; v < w; v++) {
+				r += __builtin_popcountll( ln.bits[v] );
+			}
+			return r;
+		};
+
+		//! returns the position of the set bit with rank k (k < ones()).
+		t_size_t select( t_size_t k ) const {
+			size_t lo = samples[k / SAMPLE];
+			size_t hi = (k / SAMPLE + 1 < samples.size()) ? samples[k / SAMPLE + 1] : lines.size() - 2;
+			while (lo < hi) { //find the last line with at most k set bits in front
+				size_t mid = (lo + hi + 1) / 2;
+				if (lines[mid].rank <= k)	lo = mid;
+				else                     	hi = mid - 1;
+			}
+			const line &ln = lines[lo];
+			unsigned w = 0;
+			for (k -= ln.rank; k >= (t_size_t)__builtin_popcountll( ln.bits[w] ); w++) {
+				k -= __builtin_popcountll( ln.bits[w] );
+			}
+			uint64_t x = ln.bits[w];
+#if defined(__BMI2__)
+			x = _pdep_u64( 1ull << k, x );
+#else
+			for (; k > 0; k--)	x &= x - 1;
+#endif
+			return lo * LINE_BITS + w * 64 + __builtin_ctzll( x );
+		};
+
+		//! returns the position of the last set bit in front of or at position i,
+		//! which must exist.
+		t_size_t prev( t_size_t i ) const {
+			size_t w = i / 64; //word over all lines
+			uint64_t x = lines[w / WORDS].bits[w % WORDS] & ((2ull << (i % 64)) - 1);
+			while (x == 0) {
+				--w;
+				x = lines[w / WORDS].bits[w % WORDS];
+			}
+			return w * 64 + 63 - __builtin_clzll( x );
+		};
+};
+
+//! inverts the bwt S with primary index idx (as computed by divbwt) in place, using a packed
+//! bwt with t_bits bits per character. alph lists the characters of S in ascending order.
+/*! the text is computed from back to front using LF, where LF is answered by rank queries
+   on the packed bwt. Throws an invalid_argument if the bwt is invalid.
+ */
+template<unsigned t_bits>
+void invert_packed_bwt( t_string_t &S, t_idx_t idx, const std::vector<uint8_t> &alph ) {
+	std::array<uint8_t,256> code{};
+	for (size_t c = 0; c < alph.size(); c++)	code[alph[c]] = c;
+	packed_bwt<t_bits> P( S, code );
+
+	//compute start positions of characters, row 0 belongs to the sentinel
+	std::array<t_size_t,packed_bwt<t_bits>::SIGMA> C{};
+	for (t_size_t i = 0; i < S.size(); i++)	++C[code[S[i]]];
+	t_size_t j = 1;
+	for (auto &c : C) {
+		auto cnt = c;
+		c = j;
+		j += cnt;
+	}
+
+	//walk backwards through the text, starting at the row of the sentinel
+	t_size_t r = 0, rank;
+	for (t_size_t i = S.size(); i-- > 0; ) {
+		if (r == idx)	throw std::invalid_argument("Inverse BW Transformation failed");
+		unsigned c = P.access_rank( (r < idx) ? r : r-1, rank );
+		S[i] = alph[c];
+		r = C[c] + rank;
+	}
+	if (r != idx)	throw std::invalid_argument("Inverse BW Transformation failed");
+}
+
+//! inverts the bwt S with primary index idx (as computed by divbwt) in place, if its
+//! alphabet is small. Returns false (leaving S unchanged) if S has more than 16 characters.
+inline bool invert_small_alphabet_bwt( t_string_t &S, t_idx_t idx ) {
+	if (S.size() <= 1)	return true; //nothing to invert
+	std::array<bool,256> used{};
+	for (auto c : S)	used[c] = true;
+	std::vector<uint8_t> alph;
+	for (unsigned c = 0; c < used.size(); c++) {
+		if (used[c])	alph.push_back( c );
+	}
+	if (idx == 0 || idx > S.size()) {
+		throw std::invalid_argument("Inverse BW Transformation failed");
+	}
+	if (alph.size() <= packed_bwt<2>::SIGMA) {
+		invert_packed_bwt<2>( S, idx, alph );
+	} else if (alph.size() <= packed_bwt<4>::SIGMA) {
+		invert_packed_bwt<4>( S, idx, alph );
+	} else {
+		return false;
+	}
+	return true;
+}
+
+//! inverts the tunneled bwt tbwt with auxiliary structure aux and primary index idx of a text
+//! of length n (see tunneling_support::invert_tunneled_bwt), and writes the text to out.
+//! The regular entries of tbwt are packed to t_bits bits per character, alph lists the
+//! characters of tbwt in ascending order.
+/*! instead of the PHI array of the default inversion (one index per entry), the text is
+   computed from back to front using LF, where LF is answered by rank queries on the packed
+   regular entries and select queries on the entries which are not skipped in F. As these
+   queries depend on each other, inversion is slower than the default one, but needs n bytes
+   for the text and 0.6 (t_bits = 2) or 1.3 (t_bits = 4) bytes per entry instead of 4.
+   Returns false (writing nothing) if an ignored entry differs from the regular entry in
+   front of it, whose character is used for it. Throws an invalid_argument if tbwt or aux
+   are invalid.
+ */
+template<unsigned t_bits>
+bool invert_packed_tbwt( const t_string_t &tbwt, const twobitvector &aux, t_size_t n, t_idx_t idx,
+                         const std::vector<uint8_t> &alph, std::ostream &out ) {
+	const t_size_t N = tbwt.size();
+	std::array<uint8_t,256> code{};
+	for (size_t c = 0; c < alph.size(); c++)	code[alph[c]] = c;
+
+	//pack regular entries, and count their characters
+	rank_select_bits reg( N+1, [&aux]( t_size_t i ) { return aux[i] != aux_encoding::IGN_L; } );
+	std::array<t_size_t,packed_bwt<t_bits>::SIGMA> C{};
+	t_string_t R;
+	R.reserve( reg.ones() );
+	for (t_size_t i = 0; i < N; i++) {
+		if (reg[i]) {
+			R.push_back( tbwt[i] );
+			++C[code[tbwt[i]]];
+		} else if (R.empty() || R.back() != tbwt[i]) {
+			return false;
+		}
+	}
+	packed_bwt<t_bits> P( R, code );
+	t_string_t().swap( R );
+
+	//the entries of F in order are the unskipped entries in front of idx, the start of the
+	// text, and the unskipped entries behind idx. Characters occupy consecutive entries,
+	// the first character starts behind entry 0 (as in the default inversion)
+	rank_select_bits unskipped( N+1, [&aux]( t_size_t i ) { return aux[i] != aux_encoding::SKP_F; } );
+	t_size_t j = unskipped[0];
+	for (auto &c : C) {
+		auto cnt = c;
+		c = j;
+		j += cnt;
+	}
+	if (j > unskipped.ones()) { //entry N is unskipped, but no entry of F
+		throw std::invalid_argument("auxiliary structure is invalid");
+	}
+	const t_size_t start = unskipped.rank( idx );
+
+	//walk backwards through the text, starting at row 0. Entries of aux are answered by
+	// the bitvectors, whose lines are accessed anyway
+	t_string_t T( n );
+	std::stack<t_idx_t> stck;
+	j = 0;
+	for (t_size_t i = n; i-- > 0; ) {
+		t_size_t rank, r = reg.rank( j+1 ) - 1; //last regular entry up to j
+		unsigned c = P.access_rank( r, rank );
+		T[i] = alph[c];
+		if (!unskipped[j+1]) { //end of a tunnel
+			if (stck.empty()) {
+				throw std::invalid_argument("missing start of a tunnel");
+			}
+			j += stck.top();
+			stck.pop();
+			if (j >= N || !reg[j]) {
+				throw std::invalid_argument("auxiliary structure is invalid");
+			}
+			c = P.access_rank( reg.rank( j ), rank );
+		} else if (!reg[j]) { //start of a tunnel
+			t_size_t l = reg.prev( j ); //uppermost row of the tunnel, which is entry r
+			stck.push( j - l );
+			j = l;
+		} else if (!reg[j+1]) { //start of a tunnel, being at the uppermost row
+			stck.push( 0 );
+		}
+		if (i == 0)	break;
+
+		//go to the previous suffix
+		t_size_t f = C[c] + rank;
+		if (f == start) {
+			throw std::invalid_argument("tbwt index is invalid");
+		}
+		if (f > start)	--f;
+		if (f >= unskipped.ones() || (j = unskipped.select( f )) >= N) {
+			throw std::invalid_argument("auxiliary structure is invalid");
+		}
+	}
+	if (!stck.empty()) {
+		throw std::invalid_argument("missing end of a tunnel");
+	}
+	out.write( (const char *)T.data(), T.size() );
+	return true;
+}
+
+//! inverts a tunneled bwt as invert_packed_tbwt, if its alphabet is small. Returns false
+//! (writing nothing) if tbwt has more than 16 characters or cannot be packed.
+inline bool invert_small_alphabet_tbwt( const t_string_t &tbwt, const twobitvector &aux, t_size_t n,
+                                        t_idx_t idx, std::ostream &out ) {
+	if (tbwt.size() <= 1)	return false; //nothing to gain
+	if (idx >= tbwt.size() || idx == 0) {
+		throw std::invalid_argument("tbwt index is invalid");
+	}
+	if (aux.size() <= tbwt.size() || aux[tbwt.size()] != aux_encoding::REG) {
+		throw std::invalid_argument("auxiliary structure is invalid");
+	}
+	std::array<bool,256> used{};
+	for (auto c : tbwt)	used[c] = true;
+	std::vector<uint8_t> alph;
+	for (unsigned c = 0; c < used.size(); c++) {
+		if (used[c])	alph.push_back( c );
+	}
+	if (alph.size() <= packed_bwt<2>::SIGMA) {
+		return invert_packed_tbwt<2>( tbwt, aux, n, idx, alph, out );
+	} else if (alph.size() <= packed_bwt<4>::SIGMA) {
+		return invert_packed_tbwt<4>( tbwt, aux, n, idx, alph, out );
+	}
+	return false;
+}
+
+#endif
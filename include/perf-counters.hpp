@@ -0,0 +1,141 @@
+/*
+ * perf-counters.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _PERF_COUNTERS_HPP
+#define _PERF_COUNTERS_HPP
+
+#include <array>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__linux__)
+	#include <linux/perf_event.h>
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+//! hardware performance counters of the calling thread (and threads it creates meanwhile).
+/*! counters are opened using perf_event_open, counting user space events only. Counters
+   which are not available (e.g. due to missing permissions, virtualization or other
+   operating systems) are skipped silently, so available() may be false for some or all
+   counters.
+ */
+class perf_counters {
+	public:
+		//! counted events
+		enum event_t { CYCLES = 0, INSTRUCTIONS, LLC_MISSES, DTLB_MISSES, BRANCH_MISSES, EVENTS };
+
+		//! returns the name of an event
+		static const char *name( event_t e ) {
+			static const char *names[] = { "cycles", "instructions", "llc misses", "dtlb misses", "branch misses" };
+			return names[e];
+		};
+	private:
+		std::array<int,EVENTS> fd;
+		std::array<uint64_t,EVENTS> values;
+
+#if defined(__linux__)
+		static int open_event( uint32_t type, uint64_t config ) {
+			struct perf_event_attr attr;
+			memset( &attr, 0, sizeof(attr) );
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			return (int)syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+		};
+#endif
+	public:
+		//! constructor, opens all counters (which are not started yet)
+		perf_counters() {
+			fd.fill( -1 );
+			values.fill( 0 );
+#if defined(__linux__)
+			const uint64_t DTLB_READ_MISS = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+			fd[CYCLES] = open_event( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES );
+			if (fd[CYCLES] < 0)	return; //no hardware counters at all
+			fd[INSTRUCTIONS] = open_event( PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS );
+			fd[LLC_MISSES] = open_event( PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES );
+			fd[DTLB_MISSES] = open_event( PERF_TYPE_HW_CACHE, DTLB_READ_MISS );
+			fd[BRANCH_MISSES] = open_event( PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES );
+#endif
+		};
+		perf_counters( const perf_counters & ) = delete;
+		perf_counters &operator=( const perf_counters & ) = delete;
+
+		~perf_counters() {
+#if defined(__linux__)
+			for (int f : fd) {
+				if (f >= 0)	close( f );
+			}
+#endif
+		};
+
+		//! returns whether any counter is available
+		bool any_available() const {
+			return fd[CYCLES] >= 0;
+		};
+
+		//! returns whether the counter of event e is available
+		bool available( event_t e ) const {
+			return fd[e] >= 0;
+		};
+
+		//! resets and starts all available counters
+		void start() {
+#if defined(__linux__)
+			for (int f : fd) {
+				if (f >= 0) {
+					ioctl( f, PERF_EVENT_IOC_RESET, 0 );
+					ioctl( f, PERF_EVENT_IOC_ENABLE, 0 );
+				}
+			}
+#endif
+		};
+
+		//! stops all available counters and reads their values
+		void stop() {
+#if defined(__linux__)
+			for (size_t e = 0; e < EVENTS; e++) {
+				if (fd[e] < 0)	continue;
+				ioctl( fd[e], PERF_EVENT_IOC_DISABLE, 0 );
+				if (read( fd[e], &values[e], sizeof(uint64_t) ) != sizeof(uint64_t)) {
+					close( fd[e] );
+					fd[e] = -1;
+				}
+			}
+#endif
+		};
+
+		//! returns the value of the counter of event e, counted between the last start and stop
+		uint64_t value( event_t e ) const {
+			return values[e];
+		};
+};
+
+#endif
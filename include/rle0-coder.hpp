@@ -26,7 +26,30 @@
 
 #include <limits>
 #include <stdexcept>
+#include <stdint.h>
 #include <type_traits>
+#include <vector>
+
+#include "run-scanner.hpp"
+
+namespace rle0_detail {
+	//returns the exclusive end of the run starting at position i in s[..last)
+	template<class string_t>
+	typename string_t::size_type run_end( const string_t &s, typename string_t::size_type i,
+	                                      typename string_t::size_type last ) {
+		auto e = i + 1;
+		while (e < last && s[e] == s[i])	++e;
+		return e;
+	};
+
+	//returns the exclusive end of the run starting at position i in s[..last) (vectorized for byte strings)
+	template<class A>
+	typename std::vector<uint8_t,A>::size_type run_end( const std::vector<uint8_t,A> &s,
+	                                                    typename std::vector<uint8_t,A>::size_type i,
+	                                                    typename std::vector<uint8_t,A>::size_type last ) {
+		return run_scanner::run_end( s.data(), i, last );
+	};
+};
 
 //! class for run-length-encoding of zero runs, requires a string type
 /*! template parameter string_t should support random access [], as well as
@@ -63,6 +86,11 @@ class rle0_encoder {
 			}
 		};
 
+		//! encodes a run of cnt zeros at once, equivalent to cnt calls of encode_char(0).
+		void encode_zero_run( size_type cnt ) {
+			zrl_p1 += cnt;
+		};
+
 		//! returns true if encoder has at least one more character present
 		//! for the encoding.
 		bool has_next_enc_char() const {
@@ -98,14 +126,19 @@ class rle0_encoder {
 			size_type j = 0;
 			for (size_type i = 0; i < s.size(); ) {
 
-				do {
-					if (i >= s.size())	break;
+				if (s[i] == 0) { //skip whole zero run
+					auto e = rle0_detail::run_end( s, i, s.size() );
+					encoder.encode_zero_run( e - i );
+					i = e;
+				}
+				if (i < s.size()) {
 					//check correct range
 					if (s[i] == std::numeric_limits<char_type>::max()) {
 						throw std::invalid_argument("overflow in rle0-coding");
 					}
-					//feed encoder with characters until he's ready for more output
-				} while (encoder.encode_char(s[i++]));
+					//feed encoder with the character terminating the zero run
+					encoder.encode_char(s[i++]);
+				}
 
 				//write encoder's builded sequence
 				while (encoder.has_next_enc_char()) {
@@ -0,0 +1,210 @@
+/*
+ * run-scanner.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _RUN_SCANNER_HPP
+#define _RUN_SCANNER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+#elif defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+//! namespace gathering functions to enumerate runs of equal characters in a byte string.
+/*! run boundaries are detected by comparing a vector of characters with the same
+   vector shifted by one position (AVX2 or SSE2, if available), such that long runs
+   cost one comparison per vector instead of one branch per character. On x86-64,
+   AVX2 is used if the processor supports it, even if the build does not target it.
+*/
+namespace run_scanner {
+	//scanner using the widest vectors the build targets
+	struct base_scan {
+#if defined(__AVX2__)
+		static const size_t WIDTH = 32;
+
+		//returns a mask with bit k set iff s[k] != s[k-1], for k in [0..WIDTH)
+		static inline uint64_t boundaries( const uint8_t *s ) {
+			__m256i a = _mm256_loadu_si256( (const __m256i *)s );
+			__m256i b = _mm256_loadu_si256( (const __m256i *)(s-1) );
+			return ~(uint64_t)(uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( a, b ) ) & 0xFFFFFFFFull;
+		};
+#elif defined(__SSE2__)
+		static const size_t WIDTH = 16;
+
+		//returns a mask with bit k set iff s[k] != s[k-1], for k in [0..WIDTH)
+		static inline uint64_t boundaries( const uint8_t *s ) {
+			__m128i a = _mm_loadu_si128( (const __m128i *)s );
+			__m128i b = _mm_loadu_si128( (const __m128i *)(s-1) );
+			return ~(uint64_t)_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) & 0xFFFFull;
+		};
+#else
+		static const size_t WIDTH = 8;
+
+		//returns a mask with bit k set iff s[k] != s[k-1], for k in [0..WIDTH)
+		static inline uint64_t boundaries( const uint8_t *s ) {
+			uint64_t m = 0;
+			for (size_t k = 0; k < WIDTH; k++) {
+				m |= (uint64_t)(s[k] != s[k-1]) << k;
+			}
+			return m;
+		};
+#endif
+	};
+
+	//calls f(start,length) for each maximal run of equal characters in s[first..last),
+	// in ascending order, using scanner t_scan (inlined into its callers, such that
+	// it is compiled for their target).
+	template<class t_scan, class F>
+	__attribute__((always_inline)) inline
+	void scan_runs( const uint8_t *s, size_t first, size_t last, F &f ) {
+		size_t start = first; //start of current run
+		size_t j = first + 1; //next position to be tested for a run boundary
+		for (; j + t_scan::WIDTH <= last; j += t_scan::WIDTH) {
+			for (uint64_t m = t_scan::boundaries( s + j ); m != 0; m &= m - 1) {
+				size_t b = j + __builtin_ctzll( m );
+				f( start, b - start );
+				start = b;
+			}
+		}
+		for (; j < last; j++) {
+			if (s[j] != s[j-1]) {
+				f( start, j - start );
+				start = j;
+			}
+		}
+		f( start, last - start );
+	}
+
+	//calls f(start,length) for each maximal run of equal characters in s[first..last),
+	// in descending order, using scanner t_scan (see scan_runs).
+	template<class t_scan, class F>
+	__attribute__((always_inline)) inline
+	void scan_runs_reverse( const uint8_t *s, size_t first, size_t last, F &f ) {
+		size_t end = last; //exclusive end of current run
+		size_t j = last;   //exclusive end of positions to be tested for a run boundary
+		for (; j >= first + 1 + t_scan::WIDTH; ) {
+			j -= t_scan::WIDTH;
+			for (uint64_t m = t_scan::boundaries( s + j ); m != 0; ) {
+				size_t k = 63 - __builtin_clzll( m );
+				m ^= (uint64_t)1 << k;
+				f( j + k, end - (j + k) );
+				end = j + k;
+			}
+		}
+		while (--j > first) {
+			if (s[j] != s[j-1]) {
+				f( j, end - j );
+				end = j;
+			}
+		}
+		f( first, end - first );
+	}
+
+	//returns the exclusive end of the run starting at position i in s[..last), using
+	// scanner t_scan (see scan_runs).
+	template<class t_scan>
+	__attribute__((always_inline)) inline
+	size_t scan_run_end( const uint8_t *s, size_t i, size_t last ) {
+		size_t j = i + 1;
+		for (; j + t_scan::WIDTH <= last; j += t_scan::WIDTH) {
+			uint64_t m = t_scan::boundaries( s + j );
+			if (m != 0)	return j + __builtin_ctzll( m );
+		}
+		while (j < last && s[j] == s[i])	++j;
+		return j;
+	}
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__AVX2__)
+	//scanner using AVX2, for processors supporting it (see has_avx2)
+	struct avx2_scan {
+		static const size_t WIDTH = 32;
+
+		//returns a mask with bit k set iff s[k] != s[k-1], for k in [0..WIDTH)
+		__attribute__((target("avx2")))
+		static inline uint64_t boundaries( const uint8_t *s ) {
+			__m256i a = _mm256_loadu_si256( (const __m256i *)s );
+			__m256i b = _mm256_loadu_si256( (const __m256i *)(s-1) );
+			return ~(uint64_t)(uint32_t)_mm256_movemask_epi8( _mm256_cmpeq_epi8( a, b ) ) & 0xFFFFFFFFull;
+		};
+	};
+
+	//returns whether the processor supports AVX2
+	inline bool has_avx2() {
+		static const bool b = __builtin_cpu_supports("avx2");
+		return b;
+	}
+
+	template<class F>
+	__attribute__((target("avx2")))
+	void scan_runs_avx2( const uint8_t *s, size_t first, size_t last, F &f ) {
+		scan_runs<avx2_scan>( s, first, last, f );
+	}
+
+	template<class F>
+	__attribute__((target("avx2")))
+	void scan_runs_reverse_avx2( const uint8_t *s, size_t first, size_t last, F &f ) {
+		scan_runs_reverse<avx2_scan>( s, first, last, f );
+	}
+
+	__attribute__((target("avx2")))
+	inline size_t scan_run_end_avx2( const uint8_t *s, size_t i, size_t last ) {
+		return scan_run_end<avx2_scan>( s, i, last );
+	}
+	#define RUN_SCANNER_DISPATCH_AVX2
+#endif
+
+	//! calls f(start,length) for each maximal run of equal characters in s[first..last),
+	//! in ascending order.
+	template<class F>
+	void for_each_run( const uint8_t *s, size_t first, size_t last, F f ) {
+		if (first >= last)	return;
+#ifdef RUN_SCANNER_DISPATCH_AVX2
+		if (has_avx2())	return scan_runs_avx2( s, first, last, f );
+#endif
+		scan_runs<base_scan>( s, first, last, f );
+	}
+
+	//! calls f(start,length) for each maximal run of equal characters in s[first..last),
+	//! in descending order.
+	template<class F>
+	void for_each_run_reverse( const uint8_t *s, size_t first, size_t last, F f ) {
+		if (first >= last)	return;
+#ifdef RUN_SCANNER_DISPATCH_AVX2
+		if (has_avx2())	return scan_runs_reverse_avx2( s, first, last, f );
+#endif
+		scan_runs_reverse<base_scan>( s, first, last, f );
+	}
+
+	//! returns the exclusive end of the run starting at position i in s[..last).
+	inline size_t run_end( const uint8_t *s, size_t i, size_t last ) {
+#ifdef RUN_SCANNER_DISPATCH_AVX2
+		if (has_avx2())	return scan_run_end_avx2( s, i, last );
+#endif
+		return scan_run_end<base_scan>( s, i, last );
+	}
+};
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * semi-external-bwt.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SEMI_EXTERNAL_BWT_HPP
+#define _SEMI_EXTERNAL_BWT_HPP
+
+#include "bwt-config.hpp"
+
+#include <string>
+
+//! computes the bwt of S in place like divbwt, but builds the suffix array on disk.
+/*! the suffix array is constructed semi-externally in directory dir (using sdsl's
+   construct_sa_se) and streamed from disk to compute the bwt. While the suffix array
+   is constructed, S is kept on disk as well, so the memory used is about the
+   size of S plus buffers, instead of five times the size of S.
+   Returns the primary index, or throws a runtime_error if scratch files cannot be used.
+ */
+saidx_t semi_external_bwt( t_string_t &S, const std::string &dir );
+
+#endif
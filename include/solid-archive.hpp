@@ -0,0 +1,317 @@
+/*
+ * solid-archive.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SOLID_ARCHIVE_HPP
+#define _SOLID_ARCHIVE_HPP
+
+#include "block-compressor.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <ios>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <stdexcept>
+#include <stdint.h>
+#include <streambuf>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+//! a solid archive of many files, compressed together by a block compressor.
+/*! files are concatenated and compressed as one text, such that small files share blocks
+   (and their repeats). The compressed text is followed by a file table and a trailer
+   (position of the file table, block size and a magic number):
+     compressed text | count, (name length, name, block, offset, size) * count | trailer
+   Single files are extracted by decompressing only the blocks covering them.
+ */
+class solid_archive {
+	public:
+		//! entry of the file table
+		struct entry {
+			std::string name;
+			uint64_t block; //index of the block containing the first byte of the file
+			uint64_t offset; //offset of the file in this block
+			uint64_t size; //length of the file
+		};
+	private:
+		static const uint64_t MAGIC = 0x64696c6f73747774ULL; //"twtsolid" in little endian
+		static const size_t TRAILER_SIZE = 3 * sizeof(uint64_t);
+
+		const block_compressor &c;
+		std::vector<entry> table;
+		uint64_t block_size = 0;
+
+		//input stream buffer reading the concatenation of files, supports seeking
+		class concat_istreambuf : public std::streambuf {
+			private:
+				const std::vector<std::string> &paths;
+				std::vector<uint64_t> start; //start of each file in the concatenation, and total length
+				std::vector<char> buf;
+				uint64_t bufpos = 0; //position of buf in the concatenation
+				std::ifstream f;
+				size_t cur = 0; //index of the open file
+			public:
+				concat_istreambuf( const std::vector<std::string> &p, const std::vector<uint64_t> &sizes )
+				                 : paths( p ), start( 1, 0 ), buf( 1 << 20 ) {
+					for (auto s : sizes)	start.push_back( start.back() + s );
+					setg( buf.data(), buf.data(), buf.data() );
+				};
+			protected:
+				virtual int_type underflow() {
+					uint64_t pos = bufpos + (gptr() - eback());
+					if (pos >= start.back())	return traits_type::eof();
+					//last file starting at or before pos, which is not empty
+					size_t i = std::upper_bound( start.begin(), start.end(), pos ) - start.begin() - 1;
+					if (!f.is_open() || i != cur) {
+						f.close();
+						f.clear();
+						f.open( paths[i], std::ifstream::binary );
+						cur = i;
+					}
+					size_t len = std::min<uint64_t>( buf.size(), start[i+1] - pos );
+					f.seekg( pos - start[i] );
+					f.read( buf.data(), len );
+					if (!f || (size_t)f.gcount() != len) {
+						throw std::runtime_error("unable to read file \"" + paths[i] + "\"");
+					}
+					bufpos = pos;
+					setg( buf.data(), buf.data(), buf.data() + len );
+					return traits_type::to_int_type( buf[0] );
+				};
+				virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+				                          std::ios_base::openmode which = std::ios_base::in ) {
+					off_type base = (dir == std::ios_base::beg) ? 0 :
+					                (dir == std::ios_base::cur) ? (off_type)(bufpos + (gptr() - eback())) : start.back();
+					return seekpos( base + off, which );
+				};
+				virtual pos_type seekpos( pos_type p, std::ios_base::openmode which = std::ios_base::in ) {
+					off_type o = p;
+					if (!(which & std::ios_base::in) || o < 0 || (uint64_t)o > start.back())	return pos_type( off_type( -1 ) );
+					bufpos = o;
+					setg( buf.data(), buf.data(), buf.data() );
+					return p;
+				};
+		};
+
+		//output stream buffer distributing its input to the files of the table, in order
+		class split_ostreambuf : public std::streambuf {
+			private:
+				const std::vector<entry> &table;
+				const std::function<std::unique_ptr<std::ostream>( const entry & )> &open;
+				std::vector<char> buf;
+				size_t cur = 0; //index of the current file
+				uint64_t left = 0; //bytes left of the current file
+				std::unique_ptr<std::ostream> out; //stream of the current file (empty if skipped)
+
+				//opens files until the current one is not empty, or all are done
+				void next() {
+					for (; left == 0 && cur < table.size(); cur++) {
+						out = open( table[cur] );
+						left = table[cur].size;
+						if (left > 0)	return;
+					}
+					out.reset();
+				};
+
+				void pass() {
+					const char *s = pbase();
+					for (uint64_t n = pptr() - pbase(); n > 0; ) {
+						if (left == 0) {
+							cur++;
+							next();
+							if (left == 0)	throw std::invalid_argument("archive longer than its files");
+						}
+						uint64_t w = std::min( left, n );
+						if (out)	out->write( s, w );
+						s += w; n -= w; left -= w;
+					}
+					setp( buf.data(), buf.data() + buf.size() );
+				};
+			public:
+				split_ostreambuf( const std::vector<entry> &t, const std::function<std::unique_ptr<std::ostream>( const entry & )> &o )
+				                : table( t ), open( o ), buf( 1 << 20 ) {
+					setp( buf.data(), buf.data() + buf.size() );
+					next();
+				};
+
+				//returns whether all files were written completely
+				bool complete() {
+					pass();
+					if (left == 0 && cur < table.size())	cur++;
+					next(); //opens remaining empty files
+					return left == 0 && cur >= table.size();
+				};
+			protected:
+				virtual int_type overflow( int_type ch ) {
+					pass();
+					if (!traits_type::eq_int_type( ch, traits_type::eof() )) {
+						*pptr() = traits_type::to_char_type( ch );
+						pbump( 1 );
+					}
+					return traits_type::not_eof( ch );
+				};
+				virtual int sync() {
+					pass();
+					return 0;
+				};
+		};
+	public:
+		//! constructor, expects the compressor used for archives.
+		solid_archive( const block_compressor &comp ) : c( comp ) {};
+
+		//! returns name without leading slashes and without empty, "." and ".." components,
+		//! such that it is extracted below the current directory. Throws an invalid argument
+		//! exception if no name remains.
+		static std::string safe_name( const std::string &name ) {
+			std::string safe;
+			for (size_t b = 0, e; b <= name.size(); b = e + 1) {
+				e = std::min( name.find( '/', b ), name.size() );
+				std::string part = name.substr( b, e - b );
+				if (part.empty() || part == "." || part == "..")	continue;
+				if (!safe.empty())	safe += '/';
+				safe += part;
+			}
+			if (safe.empty())	throw std::invalid_argument("unsafe file name \"" + name + "\"");
+			return safe;
+		};
+
+		//! compresses the files at paths into an archive written to out, which must be at its
+		//! start. Names of files are their paths made safe (see safe_name). Throws a runtime
+		//! error if a file can not be read.
+		void create( const std::vector<std::string> &paths, std::ostream &out ) {
+			create( paths, paths, out );
+		};
+
+		//! compresses the files at paths into an archive written to out, naming file paths[i]
+		//! names[i] made safe (see safe_name). Throws an invalid argument exception if a name
+		//! can not be made safe or names a file twice, before anything is written, and a
+		//! runtime error if a file can not be read.
+		void create( const std::vector<std::string> &paths, const std::vector<std::string> &names,
+		             std::ostream &out ) {
+			if (names.size() != paths.size())	throw std::invalid_argument("a name is required for each file");
+			table.clear();
+			block_size = c.get_block_size();
+			std::vector<uint64_t> sizes;
+			uint64_t n = 0;
+			for (size_t i = 0; i < paths.size(); i++) {
+				struct stat st;
+				if (stat( paths[i].c_str(), &st ) != 0 || !S_ISREG( st.st_mode )) {
+					throw std::runtime_error("unable to read file \"" + paths[i] + "\"");
+				}
+				sizes.push_back( st.st_size );
+				table.push_back( entry{ safe_name( names[i] ), n / block_size, n % block_size, sizes.back() } );
+				n += sizes.back();
+			}
+			std::set<std::string> unique;
+			for (auto &e : table) {
+				if (!unique.insert( e.name ).second)	throw std::invalid_argument("duplicate file name \"" + e.name + "\"");
+			}
+
+			//compress concatenation, followed by file table and trailer
+			concat_istreambuf cb( paths, sizes );
+			std::istream in( &cb );
+			c.compress( in, out );
+			uint64_t table_pos = out.tellp();
+			block_compressor::write_primitive<uint64_t>( table.size(), out );
+			for (auto &e : table) {
+				block_compressor::write_primitive<uint64_t>( e.name.size(), out );
+				out.write( e.name.data(), e.name.size() );
+				block_compressor::write_primitive<uint64_t>( e.block, out );
+				block_compressor::write_primitive<uint64_t>( e.offset, out );
+				block_compressor::write_primitive<uint64_t>( e.size, out );
+			}
+			block_compressor::write_primitive<uint64_t>( table_pos, out );
+			block_compressor::write_primitive<uint64_t>( block_size, out );
+			block_compressor::write_primitive<uint64_t>( MAGIC, out );
+			out.flush();
+		};
+
+		//! reads the file table of the archive in. Throws an invalid argument exception
+		//! if in is not an archive.
+		void open( std::istream &in ) {
+			in.exceptions( std::istream::badbit | std::istream::eofbit );
+			in.seekg( 0, std::ios_base::end );
+			std::streamoff end = in.tellg();
+			if (end < (std::streamoff)TRAILER_SIZE)	throw std::invalid_argument("not a solid archive");
+			in.seekg( end - (std::streamoff)TRAILER_SIZE );
+			auto table_pos = block_compressor::read_primitive<uint64_t>( in );
+			block_size = block_compressor::read_primitive<uint64_t>( in );
+			if (block_compressor::read_primitive<uint64_t>( in ) != MAGIC || block_size == 0
+			    || table_pos > (uint64_t)end - TRAILER_SIZE) {
+				throw std::invalid_argument("not a solid archive");
+			}
+
+			in.seekg( table_pos );
+			table.clear();
+			auto cnt = block_compressor::read_primitive<uint64_t>( in );
+			for (uint64_t i = 0; i < cnt; i++) {
+				auto len = block_compressor::read_primitive<uint64_t>( in );
+				if (len > (uint64_t)(end - in.tellg()))	throw std::invalid_argument("invalid file table");
+				std::string name( len, '\0' );
+				in.read( &name[0], len );
+				auto block = block_compressor::read_primitive<uint64_t>( in );
+				auto offset = block_compressor::read_primitive<uint64_t>( in );
+				auto size = block_compressor::read_primitive<uint64_t>( in );
+				if (offset >= block_size)	throw std::invalid_argument("invalid file table");
+				table.push_back( entry{ name, block, offset, size } );
+			}
+			if (in.tellg() != (std::streamoff)(end - TRAILER_SIZE))	throw std::invalid_argument("invalid file table");
+		};
+
+		//! returns the file table of the archive created or opened last.
+		const std::vector<entry> &files() const {
+			return table;
+		};
+
+		//! returns the entry of the file with the given name, or nullptr if there is none.
+		const entry *find( const std::string &name ) const {
+			for (auto &e : table) {
+				if (e.name == name)	return &e;
+			}
+			return nullptr;
+		};
+
+		//! extracts file e of the archive in (see open) to out, decompressing only the
+		//! blocks covering the file (see block_compressor::decompress_range).
+		void extract( std::istream &in, const entry &e, std::ostream &out,
+		              block_compressor::block_cache *cache = nullptr ) const {
+			c.decompress_range( in, e.block * block_size + e.offset, e.size, out, cache );
+		};
+
+		//! extracts all files of the archive in (see open) by decompressing it once. For
+		//! each file, in order of the table, open returns the stream receiving the file
+		//! (or an empty pointer to skip it).
+		void extract_all( std::istream &in, const std::function<std::unique_ptr<std::ostream>( const entry & )> &open ) const {
+			split_ostreambuf sb( table, open );
+			std::ostream out( &sb );
+			in.seekg( 0 );
+			c.decompress( in, out );
+			if (!sb.complete())	throw std::invalid_argument("archive shorter than its files");
+		};
+};
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * span-streambuf.hpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _SPAN_STREAMBUF_HPP
+#define _SPAN_STREAMBUF_HPP
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+#include <ostream>
+#include <stddef.h>
+#include <stdint.h>
+#include <streambuf>
+#include <vector>
+
+//! stream buffer reading from a caller-provided memory range without copying it.
+/*! the buffer supports seeking, such that it can be used as input of block compressors.
+ */
+class span_istreambuf : public std::streambuf {
+	public:
+		//! constructor, expects the range s[0..n-1], which must outlive the buffer.
+		span_istreambuf( const char *s, size_t n ) {
+			char *p = const_cast<char *>( s );
+			setg( p, p, p + n );
+		};
+	protected:
+		virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+		                          std::ios_base::openmode which = std::ios_base::in ) {
+			off_type base = (dir == std::ios_base::beg) ? 0 :
+			                (dir == std::ios_base::cur) ? gptr() - eback() : egptr() - eback();
+			return seekpos( base + off, which );
+		};
+		virtual pos_type seekpos( pos_type p, std::ios_base::openmode which = std::ios_base::in ) {
+			off_type o = p;
+			if (!(which & std::ios_base::in) || o < 0 || o > egptr() - eback())	return pos_type( off_type( -1 ) );
+			setg( eback(), eback() + o, egptr() );
+			return p;
+		};
+};
+
+//! stream buffer writing into a caller-provided memory range of fixed capacity.
+/*! writes behind the end of the range fail (so streams set their badbit) and are
+   remembered, see exhausted(). The buffer supports seeking within written data.
+ */
+class span_ostreambuf : public std::streambuf {
+	private:
+		char *written; //end of the written part of the range
+		bool full = false; //whether a write failed due to missing capacity
+
+		//moves the put position to offset o of the range
+		void move_to( off_type o ) {
+			setp( pbase(), epptr() );
+			for (; o > 0; o -= std::min<off_type>( o, std::numeric_limits<int>::max() )) {
+				pbump( (int)std::min<off_type>( o, std::numeric_limits<int>::max() ) );
+			}
+		};
+	public:
+		//! constructor, expects the range s[0..n-1], which must outlive the buffer.
+		span_ostreambuf( char *s, size_t n ) : written( s ) {
+			setp( s, s + n );
+		};
+
+		//! returns the number of bytes written, i.e. the end of the written part of the range.
+		size_t size() const {
+			return std::max( written, pptr() ) - pbase();
+		};
+
+		//! returns whether a write failed since the capacity of the range was exceeded.
+		bool exhausted() const {
+			return full;
+		};
+	protected:
+		virtual int_type overflow( int_type ) {
+			full = true;
+			return traits_type::eof();
+		};
+		virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+		                          std::ios_base::openmode which = std::ios_base::out ) {
+			off_type base = (dir == std::ios_base::beg) ? 0 :
+			                (dir == std::ios_base::cur) ? pptr() - pbase() : (off_type)size();
+			return seekpos( base + off, which );
+		};
+		virtual pos_type seekpos( pos_type p, std::ios_base::openmode which = std::ios_base::out ) {
+			off_type o = p;
+			if (!(which & std::ios_base::out) || o < 0 || o > (off_type)size())	return pos_type( off_type( -1 ) );
+			written = std::max( written, pptr() );
+			move_to( o );
+			return p;
+		};
+};
+
+//! stream buffer writing into a vector of bytes, which is enlarged as necessary.
+/*! writing starts at the beginning of the vector, and its memory is kept (the vector is
+   not shrunk), so vectors can be reused by many buffers without allocating them again.
+   The buffer supports seeking within written data.
+ */
+template<class t_vector>
+class vector_ostreambuf : public std::streambuf {
+	static_assert( sizeof(typename t_vector::value_type) == 1, "vector must consist of bytes" );
+	private:
+		t_vector &v;
+		size_t written = 0; //length of the written part of the vector
+
+		//moves the put position to offset o of the vector
+		void move_to( off_type o ) {
+			setp( (char *)v.data(), (char *)v.data() + v.size() );
+			for (; o > 0; o -= std::min<off_type>( o, std::numeric_limits<int>::max() )) {
+				pbump( (int)std::min<off_type>( o, std::numeric_limits<int>::max() ) );
+			}
+		};
+	public:
+		//! constructor, expects the vector written to, which must outlive the buffer.
+		vector_ostreambuf( t_vector &vec ) : v( vec ) {
+			if (v.size() < 4096)	v.resize( 4096 );
+			move_to( 0 );
+		};
+
+		//! returns the number of bytes written, i.e. the end of the written part of the vector.
+		size_t size() const {
+			return std::max( written, (size_t)(pptr() - pbase()) );
+		};
+
+		//! returns the written bytes, which are valid until the next write.
+		const char *data() const {
+			return pbase();
+		};
+	protected:
+		virtual int_type overflow( int_type ch ) {
+			if (traits_type::eq_int_type( ch, traits_type::eof() ))	return traits_type::not_eof( ch );
+			off_type o = pptr() - pbase();
+			written = size();
+			v.resize( 2 * v.size() );
+			move_to( o );
+			*pptr() = traits_type::to_char_type( ch );
+			pbump( 1 );
+			return ch;
+		};
+		virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+		                          std::ios_base::openmode which = std::ios_base::out ) {
+			off_type base = (dir == std::ios_base::beg) ? 0 :
+			                (dir == std::ios_base::cur) ? pptr() - pbase() : (off_type)size();
+			return seekpos( base + off, which );
+		};
+		virtual pos_type seekpos( pos_type p, std::ios_base::openmode which = std::ios_base::out ) {
+			off_type o = p;
+			if (!(which & std::ios_base::out) || o < 0 || o > (off_type)size())	return pos_type( off_type( -1 ) );
+			written = size();
+			move_to( o );
+			return p;
+		};
+};
+
+//! stream buffer passing the part [skip..skip+len-1] of its input to another stream.
+/*! the remaining input is discarded. Input is buffered, so the part is passed completely
+   after the buffer was synchronized (e.g. by flushing the stream using it).
+ */
+class window_ostreambuf : public std::streambuf {
+	private:
+		std::ostream &out;
+		uint64_t skip; //bytes to be discarded before the part
+		uint64_t len; //bytes left of the part
+		std::vector<char> buf;
+
+		//passes the buffered input, as far as it belongs to the part
+		void pass() {
+			uint64_t n = pptr() - pbase();
+			uint64_t k = std::min( skip, n );
+			uint64_t w = std::min( len, n - k );
+			out.write( pbase() + k, w );
+			skip -= k;
+			len -= w;
+			setp( buf.data(), buf.data() + buf.size() );
+		};
+	public:
+		//! constructor, expects the stream receiving the part, and start and length of the part.
+		window_ostreambuf( std::ostream &o, uint64_t s, uint64_t l ) : out( o ), skip( s ), len( l ), buf( 1 << 16 ) {
+			setp( buf.data(), buf.data() + buf.size() );
+		};
+	protected:
+		virtual int_type overflow( int_type ch ) {
+			pass();
+			if (!traits_type::eq_int_type( ch, traits_type::eof() )) {
+				*pptr() = traits_type::to_char_type( ch );
+				pbump( 1 );
+			}
+			return traits_type::not_eof( ch );
+		};
+		virtual int sync() {
+			pass();
+			return 0;
+		};
+};
+
+#endif
@@ -26,177 +26,283 @@
 
 #include "block-compressor.hpp"
 
+#include "aux-coder.hpp"
 #include "aux-encoding.hpp"
 #include "bwt-config.hpp"
 #include "bwt-run-support.hpp"
 #include "divsufsort.h"
-#include "lheap.hpp"
+#include "huge-page-allocator.hpp"
+#include "packed-bwt.hpp"
+#include "semi-external-bwt.hpp"
+#include "span-streambuf.hpp"
 #include "tunneling-support.hpp"
 
 #include <array>
 #include <assert.h>
 #include <chrono>
+#include <exception>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
 //! a tunneled-bwt-based generic compressor
 template<class t_2st_encoder>
 class tbwt_compressor : public block_compressor {
+	private:
+		//state of a block after its BW-transformation
+		struct bwt_block_state : public block_state {
+			saidx_t bwt_idx = 0;
+		};
+
+		//header of an encoded block
+		struct block_header {
+			t_size_t n; //length of the text
+			t_size_t tbwt_size; //length of the tunneled bwt
+			t_size_t aux_size; //length of the (run-based) aux
+			t_idx_t tbwt_idx; //primary index of the tunneled bwt
+			uint64_t tbwt_enc_size; //size of the tbwt encoding in bytes
+			uint64_t aux_enc_size; //size of the aux encoding in bytes
+		};
+		//reads and checks the header of a block, which ends at position end of in
+		static block_header read_header( std::istream &in, std::streampos end );
+		//writes the header h of a block
+		static void write_header( const block_header &h, std::ostream &out );
 	protected:
-		virtual void compress_block( std::istream &in, std::streampos end, std::ostream &out ) const;
 		virtual void decompress_block( std::istream &in, std::streampos end, std::ostream &out ) const;
+		virtual void transcode_block( std::istream &in, std::streampos end, std::ostream &out,
+		                              const block_compressor &from ) const;
+
+		virtual std::unique_ptr<block_state> make_block_state() const {
+			return std::unique_ptr<block_state>( new bwt_block_state() );
+		};
+		virtual void transform_block( block_state &bs ) const;
+		virtual void encode_block( block_state &bs, std::ostream &out ) const;
 	public:
 		//! constructor
 		tbwt_compressor() : block_compressor( t_max_size ) {};
+
+		//! result of a block choice, see choose_blocks
+		typedef typename tunneling_support<t_2st_encoder>::block_choice block_choice;
+
+		//! chooses the blocks to be tunneled (see tunneling_support::choose_blocks).
+		static block_choice choose_blocks( tunneling_support<t_2st_encoder> &ts, std::vector<t_idx_t> &H ) {
+			return ts.choose_blocks( H );
+		};
+
+		virtual uint32_t format_id() const {
+			return 0x100 | t_2st_encoder::FORMAT_ID; //tunneled
+		};
+		virtual std::string transformation() const {
+			return "tbwt";
+		};
+		virtual void decode_transformed( std::istream &in, text_t &t ) const {
+			t_2st_encoder::decode( in, t );
+		};
+		virtual void encode_transformed( text_t &t, std::ostream &out ) const {
+			t_2st_encoder::encode( t, out );
+		};
 };
 
+template<class t_ss_e>
+typename tbwt_compressor<t_ss_e>::block_header tbwt_compressor<t_ss_e>::read_header( std::istream &in, std::streampos end ) {
+	using namespace std;
+	block_header h;
+	h.n = read_primitive<t_size_t>( in );
+	h.tbwt_size = read_primitive<t_size_t>( in );
+	h.aux_size = read_primitive<t_size_t>( in );
+	h.tbwt_idx = read_primitive<t_idx_t>( in );
+	h.tbwt_enc_size = read_primitive<uint64_t>( in );
+	h.aux_enc_size = read_primitive<uint64_t>( in );
+	auto tbwt_enc_pos = in.tellg();
+	//do some checks
+	if (h.n > t_max_size) {
+		throw invalid_argument("text(part) is too long to be decoded!");
+	}
+	if (h.tbwt_size != 0 && (h.tbwt_idx >= h.tbwt_size || h.tbwt_idx == 0)) {
+		throw invalid_argument("invalid bwt index");
+	}
+	if (h.aux_size > h.tbwt_size+1) {
+		throw invalid_argument("aux size is longer than tbwt size");
+	}
+	if (end < tbwt_enc_pos || h.tbwt_enc_size > (uint64_t)(end - tbwt_enc_pos) ||
+	    h.aux_enc_size != (uint64_t)(end - tbwt_enc_pos) - h.tbwt_enc_size) {
+		throw invalid_argument("invalid encoding sizes");
+	}
+	return h;
+}
+
+template<class t_ss_e>
+void tbwt_compressor<t_ss_e>::write_header( const block_header &h, std::ostream &out ) {
+	write_primitive<t_size_t>( h.n, out );
+	write_primitive<t_size_t>( h.tbwt_size, out );
+	write_primitive<t_size_t>( h.aux_size, out );
+	write_primitive<t_idx_t>(  h.tbwt_idx, out );
+	write_primitive<uint64_t>( h.tbwt_enc_size, out );
+	write_primitive<uint64_t>( h.aux_enc_size, out );
+}
+
 //// COMPRESSION //////////////////////////////////////////////////////////////
 
 template<class t_ss_e>
-void tbwt_compressor<t_ss_e>::compress_block( std::istream &in, std::streampos end, std::ostream &out ) const {
+void tbwt_compressor<t_ss_e>::transform_block( block_state &bs ) const {
 	using namespace std;
 	using namespace std::chrono;
-	typedef typename istream::char_type schar_t;
 	typedef high_resolution_clock timer;
-	static_assert( is_same<
-	                    typename make_unsigned<schar_t>::type,
-	                    typename make_unsigned<t_uchar_t>::type
-	               >::value,
+	static_assert( is_same< t_string_t, decltype(bs.data) >::value,
 	               "character types must be compatible" );
 
 	//// GET INPUT ////////////////////////////////////////////////////////
 
-	//get length of input
-	t_size_t n = (t_size_t)(end - in.tellg());
+	t_string_t &S = bs.data;
+	t_size_t n = S.size();
 	assert(n <= t_max_size );
-	print_info("input size", n);
-
-	//read string from input and reverse it
-	t_string_t S( n );
-	in.read( (schar_t *)S.data(), n );
+	record_bytes("input size", n);
 
 	//// BW-TRANSFORM INPUT ///////////////////////////////////////////////
 
+	auto counters = start_counters();
 	auto start = timer::now();
-	saidx_t bwt_idx = 0;
-	if (bw_transform(S.data(), S.data(), NULL, (saidx_t)n, &bwt_idx) < 0) {
+	saidx_t &bwt_idx = static_cast<bwt_block_state &>( bs ).bwt_idx;
+	if (get_memory_budget() != 0 && (uint64_t)n * (1 + sizeof(saidx_t)) > get_memory_budget()) {
+		//text and suffix array do not fit into the budget, construct suffix array on disk
+		print_info("bwt construction", "semi-external");
+		bwt_idx = semi_external_bwt( S, get_scratch_dir() );
+	} else {
+		//provide the suffix array space, such that it follows the memory policy and is
+		//reused by compressions sharing a context
+		scratch_memory SA( bs );
+		bwt_idx = divbwt(S.data(), S.data(), SA.array<saidx_t>( n+1 ), (saidx_t)n);
+	}
+	if (bwt_idx < 0) {
 		throw runtime_error( string("BW Transformation failed") );
 	}
 	auto stop = timer::now();
-	print_info("bwt construction time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
+	record_counters("bwt construction", counters );
+	record_duration("bwt construction time", stop - start );
+	print_info("memory policy", memory_policy::used() );
+}
+
+template<class t_ss_e>
+void tbwt_compressor<t_ss_e>::encode_block( block_state &bs, std::ostream &out ) const {
+	using namespace std;
+	using namespace std::chrono;
+	typedef high_resolution_clock timer;
+
+	t_string_t &S = bs.data;
+	t_size_t n = S.size();
+	saidx_t bwt_idx = static_cast<bwt_block_state &>( bs ).bwt_idx;
 
 	//// SET UP BWT NAVIGATION ////////////////////////////////////////////
 
-	start = timer::now();
+	auto counters = start_counters();
+	auto start = timer::now();
 	bwt_run_support bwtrs( S.data(), n, bwt_idx );
 
 	//// COMPUTE BLOCKS AND COLLISIONS ////////////////////////////////////
 
 	tunneling_support<t_ss_e> ts( bwtrs );
-	stop = timer::now();
-	print_info("block computation time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
+	auto stop = timer::now();
+	record_counters("block computation", counters );
+	record_duration("block computation time", stop - start );
+	record_count("run count", bwtrs.runs );
 
-	//// SET UP A HEAP CONTAINING BLOCKS //////////////////////////////////
-
-	//a mapper between block states and heap states
-	struct _bs_lhvs_mapper {
-		array<int,aux_encoding::SIGMA> map;
-		_bs_lhvs_mapper() {
-			map[tunneling_support<t_ss_e>::UNCHANGED] = lheap_vstate::unchanged;
-			map[tunneling_support<t_ss_e>::DECREASED] = lheap_vstate::decreased;
-			map[tunneling_support<t_ss_e>::CLEARED  ] = lheap_vstate::empty;
-		};
-	} bs_lhvs_mapper;
+	//// CHOOSE BLOCKS TO BE TUNNELED /////////////////////////////////////
 
+	counters = start_counters();
 	start = timer::now();
-
-	vector<t_idx_t> H; //heap space
-	H.reserve( ts.bns.blocks ); //put all blocks to a heap which are worth to be tunneled
-	for (t_idx_t b = 0; b < ts.bns.blocks; b++) {
-		if (ts.blockstate(b) != tunneling_support<t_ss_e>::CLEARED) {
-			H.push_back( b );
-		}
-	}
-	//create function for block comparison
-	auto blockcmp = [&ts]( t_idx_t b1, t_idx_t b2 ) {
-		return ts.tes.blockscore(b1) < ts.tes.blockscore(b2);
-	};
-	//create function for block score state
-	auto blockstate = [&ts,&bs_lhvs_mapper]( t_idx_t b ) {
-		return bs_lhvs_mapper.map[ts.blockstate(b)];
-	};
-	//create the initial heap
-	make_lheap( H.begin(), H.end(), blockcmp );
-
-	//// SEARCH FOR AN OPTIMAL BLOCK CHOICE ///////////////////////////////
-
-	auto bc_tbwt_benefit = ts.tes.current_tbwt_gross_benefit(); //best choice tbwt run encoding benefit
-	auto bc_aux_tax = ts.tes.current_aux_tax(); //best choice aux size
-	t_size_t bc_tunnel_cnt = 0; //number of tunnels under best choice
-
-	auto SB = H.rbegin(); //array to store sorted blocks
-
-	for (auto e = H.end(); e != H.begin(); ) {
-
-		auto b = H.front(); //get block with maximal score
-		ts.tunnel_block_symbolic( b ); //symbolically tunnel block with best score
-
-		//remove block from heap, and store it in SB (similar to heapsort)
-		e = pop_lheap_nomove(H.begin(), e, blockstate, blockcmp);
-		*(SB++) = b;
-
-		//check if new encoding is smaller
-		auto current_tbwt_benefit = ts.tes.current_tbwt_gross_benefit();
-		auto current_aux_tax = ts.tes.current_aux_tax();
-		if (current_tbwt_benefit - bc_tbwt_benefit >=
-		    current_aux_tax - bc_aux_tax) {
-
-			bc_tbwt_benefit = current_tbwt_benefit;
-			bc_aux_tax = current_aux_tax;
-			bc_tunnel_cnt = distance( H.rbegin(), SB );
-		}
-	}
-
+	vector<t_idx_t> H;
+	block_choice bc = choose_blocks( ts, H );
 	stop = timer::now();
-	print_info("block choice time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
-	print_info("block count", H.size());
-	print_info("tunneled block count", bc_tunnel_cnt);
-	print_info("expected tbwt gross benefit size", bc_tbwt_benefit / numeric_limits<t_uchar_t>::digits );
-	print_info("expected aux tax size", bc_aux_tax / numeric_limits<t_uchar_t>::digits );
+	record_counters("block choice", counters );
+	record_duration("block choice time", stop - start );
+	record_count("block count", H.size());
+	record_count("tunneled block count", bc.tunnel_cnt);
+	record_bytes("estimated tbwt gross benefit size", bc.tbwt_benefit / numeric_limits<t_uchar_t>::digits );
+	record_bytes("estimated aux encoding size", bc.aux_tax / numeric_limits<t_uchar_t>::digits );
 
 	//// TUNNEL BEST CHOICE OF BLOCKS /////////////////////////////////////
 
+	counters = start_counters();
 	start = timer::now();
 	twobitvector aux; //auxiliary structure for tunneling
-	auto tbwt_idx = ts.tunnel_bwt( S, aux, H.rbegin(), (H.rbegin()+bc_tunnel_cnt) );
+	auto tbwt_idx = ts.tunnel_bwt( S, aux, H.rbegin(), (H.rbegin()+bc.tunnel_cnt), get_threads() );
 	move( ts ); move( bwtrs ); move( H ); //get rid of some structures
 	stop = timer::now();
-	print_info("tunneling time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );	
+	record_counters("tunneling", counters );
+	record_duration("tunneling time", stop - start );	
 
 	//// WRITE ENCODING ///////////////////////////////////////////////////
 
+	counters = start_counters();
 	start = timer::now();
 	t_ss_e::transform_aux( S, tbwt_idx, aux );
 
-	write_primitive<t_size_t>( n, out );
-	write_primitive<t_size_t>( S.size(), out );
-	write_primitive<t_size_t>( aux.size(), out );
-	write_primitive<t_idx_t>(  tbwt_idx, out );
+	//encode aux into a buffer, concurrently to the tbwt if threads are available
+	scratch_memory auxmem( bs );
+	vector_ostreambuf<text_t> auxbuf( auxmem.vector() );
+	ostream auxenc( &auxbuf );
+	auxenc.exceptions( ostream::badbit );
+	exception_ptr auxerr;
+	auto encode_aux = [&aux,&auxenc,&auxerr]() {
+		try {
+			aux_coder::encode( aux, auxenc );
+		} catch (...) {
+			auxerr = current_exception();
+		}
+	};
+	thread auxthread;
+	if (get_threads() > 1) {
+		auxthread = stage_thread( encode_aux );
+	}
 
-	auto tbwencstartpos = out.tellp();
-	t_ss_e::encode( S, out );
-	auto auxencstartpos = out.tellp();
-	t_ss_e::encode( aux, out );
+	//write header, sizes of encodings are set afterwards
+	block_header h = { n, (t_size_t)S.size(), (t_size_t)aux.size(), (t_idx_t)tbwt_idx, 0, 0 };
+	streampos headerpos, tbwencstartpos, auxencstartpos;
+	exception_ptr tbwterr;
+	try {
+		headerpos = out.tellp();
+		write_header( h, out );
+
+		tbwencstartpos = out.tellp();
+		t_ss_e::encode( S, out );
+		auxencstartpos = out.tellp();
+	} catch (...) {
+		tbwterr = current_exception();
+	}
+
+	if (auxthread.joinable()) {
+		auxthread.join();
+	} else if (!tbwterr) {
+		encode_aux();
+	}
+	if (tbwterr) {
+		rethrow_exception( tbwterr );
+	}
+	if (auxerr) {
+		rethrow_exception( auxerr );
+	}
+	out.write( auxbuf.data(), auxbuf.size() );
+
+	//store sizes of encodings, such that they can be decoded independently
+	auto encendpos = out.tellp();
+	h.tbwt_enc_size = auxencstartpos - tbwencstartpos;
+	h.aux_enc_size = auxbuf.size();
+	out.seekp( headerpos );
+	write_header( h, out );
+	out.seekp( encendpos );
 
 	stop = timer::now();
-	print_info("encoding time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
-	print_info("tbwt encoding size", auxencstartpos - tbwencstartpos );
-	print_info("aux encoding size", out.tellp() - auxencstartpos );
+	record_counters("encoding", counters );
+	record_duration("encoding time", stop - start );
+	record_bytes("tbwt encoding size", auxencstartpos - tbwencstartpos );
+	record_bytes("aux encoding size", auxbuf.size() );
 }
 
 //// DECOMPRESSION ////////////////////////////////////////////////////////////
@@ -215,40 +321,141 @@ void tbwt_compressor<t_ss_e>::decompress_block( std::istream &in, std::streampos
 
 	//// READ HEADER //////////////////////////////////////////////////////
 
+	auto counters = start_counters();
 	auto start = timer::now();
-	auto n = read_primitive<t_size_t>( in );
-	auto tbwt_size = read_primitive<t_size_t>( in );
-	auto aux_size = read_primitive<t_size_t>( in );
-	auto tbwt_idx = read_primitive<t_idx_t>( in );
-	//do some checks
-	if (n > t_max_size) {
-		throw invalid_argument("text(part) is too long to be decoded!");
-	}
-	if (tbwt_size != 0 && (tbwt_idx >= tbwt_size || tbwt_idx == 0)) {
-		throw invalid_argument("invalid bwt index");
-	}
-	if (aux_size > tbwt_size+1) {
-		throw invalid_argument("aux size is longer than tbwt size");
-	}
+	const block_header h = read_header( in, end );
+	const auto n = h.n, tbwt_size = h.tbwt_size, aux_size = h.aux_size;
+	const auto tbwt_idx = h.tbwt_idx;
+	const auto tbwt_enc_size = h.tbwt_enc_size, aux_enc_size = h.aux_enc_size;
+	auto tbwt_enc_pos = in.tellg();
 
 	//// DECODE TUNNELED BWT USING ENCODING SUPPORT ///////////////////////                                    
 
 	t_string_t tbwt; tbwt.resize( tbwt_size );
 	twobitvector aux; aux.resize( aux_size );
-	t_ss_e::decode( in, tbwt );
-	t_ss_e::decode( in, aux );
+
+	//read aux encoding, and decode it concurrently to the tbwt if threads are available
+	string auxbuf( aux_enc_size, '\0' );
+	in.seekg( tbwt_enc_pos + (streamoff)tbwt_enc_size );
+	in.read( &auxbuf[0], aux_enc_size );
+	in.seekg( tbwt_enc_pos );
+
+	exception_ptr auxerr;
+	auto decode_aux = [&aux,&auxbuf,&auxerr]() {
+		try {
+			istringstream auxin( auxbuf );
+			auxin.exceptions( istream::badbit | istream::eofbit );
+			aux_coder::decode( auxin, aux );
+			if (auxin.tellg() != (streampos)auxbuf.size()) {
+				throw invalid_argument("invalid aux encoding size");
+			}
+		} catch (...) {
+			auxerr = current_exception();
+		}
+	};
+	thread auxthread;
+	if (get_threads() > 1) {
+		auxthread = stage_thread( decode_aux );
+	}
+
+	exception_ptr tbwterr;
+	try {
+		t_ss_e::decode( in, tbwt );
+		if (in.tellg() != tbwt_enc_pos + (streamoff)tbwt_enc_size) {
+			throw invalid_argument("invalid tbwt encoding size");
+		}
+	} catch (...) {
+		tbwterr = current_exception();
+	}
+
+	if (auxthread.joinable()) {
+		auxthread.join();
+	} else if (!tbwterr) {
+		decode_aux();
+	}
+	if (tbwterr) {
+		rethrow_exception( tbwterr );
+	}
+	if (auxerr) {
+		rethrow_exception( auxerr );
+	}
+	in.seekg( end );
 
 	t_ss_e::retransform_aux( tbwt, tbwt_idx, aux );
 	auto stop = timer::now();
-	print_info("decoding time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
+	record_counters("decoding", counters );
+	record_duration("decoding time", stop - start );
 
 	//// INVERT TUNNELED BWT //////////////////////////////////////////////
 
+	counters = start_counters();
+	start = timer::now();
+	//the default inversion needs the tbwt and an index per entry, if this exceeds the memory
+	// budget, small alphabets are inverted using packed characters (which is slower)
+	if (get_memory_budget() != 0 && (uint64_t)tbwt.size() * (1 + sizeof(t_idx_t)) > get_memory_budget()
+	    && invert_small_alphabet_tbwt( tbwt, aux, n, tbwt_idx, out )) {
+		print_info("tbwt inversion", "packed");
+	} else {
+		tunneling_support<t_ss_e>::invert_tunneled_bwt( move(tbwt), move(aux), n, tbwt_idx,
+		                                        numeric_limits<t_uchar_t>::max(), out );
+	}
+	stop = timer::now();
+	record_counters("tbwt inversion", counters );
+	record_duration("tbwt inversion time", stop - start );
+	print_info("memory policy", memory_policy::used() );
+}
+
+
+//// TRANSCODING //////////////////////////////////////////////////////////////
+
+template<class t_ss_e>
+void tbwt_compressor<t_ss_e>::transcode_block( std::istream &in, std::streampos end, std::ostream &out,
+                                               const block_compressor &from ) const {
+	using namespace std;
+	using namespace std::chrono;
+	typedef high_resolution_clock timer;
+
+	if (from.transformation() != transformation()) {
+		block_compressor::transcode_block( in, end, out, from );
+		return;
+	}
+
+	//// DECODE TUNNELED BWT WITH SECOND STAGE OF SOURCE //////////////////
+
+	auto counters = start_counters();
+	auto start = timer::now();
+	block_header h = read_header( in, end );
+	auto tbwt_enc_pos = in.tellg();
+	t_string_t tbwt; tbwt.resize( h.tbwt_size );
+	from.decode_transformed( in, tbwt );
+	if (in.tellg() != tbwt_enc_pos + (streamoff)h.tbwt_enc_size) {
+		throw invalid_argument("invalid tbwt encoding size");
+	}
+	//aux coding is shared by all second stages, so its encoding is kept
+	string auxbuf( h.aux_enc_size, '\0' );
+	in.read( &auxbuf[0], h.aux_enc_size );
+	auto stop = timer::now();
+	record_counters("decoding", counters );
+	record_duration("decoding time", stop - start );
+
+	//// ENCODE TUNNELED BWT WITH OWN SECOND STAGE ////////////////////////
+
+	counters = start_counters();
 	start = timer::now();
-	tunneling_support<t_ss_e>::invert_tunneled_bwt( move(tbwt), move(aux), n, tbwt_idx,
-	                                        numeric_limits<t_uchar_t>::max(), out );
+	auto headerpos = out.tellp();
+	write_header( h, out );
+	auto tbwencstartpos = out.tellp();
+	t_ss_e::encode( tbwt, out );
+	h.tbwt_enc_size = out.tellp() - tbwencstartpos;
+	out.write( auxbuf.data(), auxbuf.size() );
+	auto encendpos = out.tellp();
+	out.seekp( headerpos );
+	write_header( h, out );
+	out.seekp( encendpos );
 	stop = timer::now();
-	print_info("tbwt inversion time", (uint64_t)duration_cast<milliseconds>( stop - start ).count() );
+	record_counters("encoding", counters );
+	record_duration("encoding time", stop - start );
+	record_bytes("tbwt encoding size", h.tbwt_enc_size );
 }
 
 #endif
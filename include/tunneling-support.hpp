@@ -24,9 +24,14 @@
 #ifndef _TUNNELING_SUPPORT_HPP
 #define _TUNNELING_SUPPORT_HPP
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <ostream>
 #include <stack>
 #include <stdexcept>
+#include <stdint.h>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -34,6 +39,7 @@
 #include "block-nav-support.hpp"
 #include "bwt-config.hpp"
 #include "bwt-run-support.hpp"
+#include "lheap.hpp"
 #include "twobitvector.hpp"
 
 //! support structure for bwt tunneling.
@@ -85,8 +91,34 @@ class tunneling_support {
 		*/
 		void tunnel_block_symbolic( t_idx_t b );
 
+		//! result of a block choice, see choose_blocks
+		struct block_choice {
+			t_size_t tunnel_cnt; //number of blocks to be tunneled
+			t_bitsize_t tbwt_benefit; //expected gross benefit of the tbwt run encoding (in bits)
+			t_bitsize_t aux_tax; //expected size of the aux encoding (in bits)
+		};
+
+		//! chooses the blocks to be tunneled by symbolically tunneling all blocks in order of their score.
+		/*! H is filled with block identifiers, such that the first tunnel_cnt blocks of
+		    [H.rbegin(), H.rend()) are the blocks to be tunneled.
+		*/
+		block_choice choose_blocks( std::vector<t_idx_t> &H );
+
 //// REGION FOR TUNNELING ITSELF //////////////////////////////////////////////
 
+	private:
+		//marks the tunnel of block b in aux (intervals is used as scratch space)
+		void mark_tunnel( twobitvector &aux, t_idx_t b, std::vector<t_idx_t> &intervals );
+
+		//partitions the given blocks into groups which do not share a run or an aux word,
+		// and marks the groups concurrently
+		void mark_tunnels_parallel( twobitvector &aux, const std::vector<t_idx_t> &blocks,
+		                            unsigned threads );
+
+		//removes all entries marked as aux_encoding::REM from bwt and aux, trims both
+		// and terminates aux. Returns the new primary index
+		t_idx_t compact_tunneled_bwt( t_string_t &bwt, twobitvector &aux, unsigned threads ) const;
+
 	public:
 		//! tunnels the given BWT using the blocks given by the identifiers placed between first and last.
 		/*! Note that this object modified by this operation,
@@ -94,10 +126,11 @@ class tunneling_support {
 		    by this function. Function returns the new primary index of the tunneled bwt.
 		    Note that aux is one character longer than
 		    the tunneled BWT, because it always is terminated by aux_encoding::REG.
+		    If threads is bigger than 1, non-colliding blocks are tunneled concurrently.
 		*/
 		template<class Iterator>
 		t_idx_t tunnel_bwt( t_string_t &bwt, twobitvector &aux,
-		                 Iterator first, Iterator last );
+		                 Iterator first, Iterator last, unsigned threads = 1 );
 
 		//! inverts the given tunneled bwt.
 		/*! This means that this function not only recomputes
@@ -187,87 +220,267 @@ void tunneling_support<ttec>::tunnel_block_symbolic( t_idx_t b ) {
 	m_bns.remove_inner_outer_collisions( b );
 }
 
+template<class ttec>
+typename tunneling_support<ttec>::block_choice tunneling_support<ttec>::choose_blocks( std::vector<t_idx_t> &H ) {
+	using namespace std;
+
+	//// SET UP A HEAP CONTAINING BLOCKS //////////////////////////////////
+
+	//a mapper between block states and heap states
+	struct _bs_lhvs_mapper {
+		array<int,aux_encoding::SIGMA> map;
+		_bs_lhvs_mapper() {
+			map[UNCHANGED] = lheap_vstate::unchanged;
+			map[DECREASED] = lheap_vstate::decreased;
+			map[CLEARED  ] = lheap_vstate::empty;
+		};
+	} bs_lhvs_mapper;
+
+	H.clear(); //heap space
+	H.reserve( bns.blocks ); //put all blocks to a heap which are worth to be tunneled
+	for (t_idx_t b = 0; b < bns.blocks; b++) {
+		if (blockstate(b) != CLEARED) {
+			H.push_back( b );
+		}
+	}
+	//create function for block comparison
+	auto blockcmp = [this]( t_idx_t b1, t_idx_t b2 ) {
+		return tes.blockscore(b1) < tes.blockscore(b2);
+	};
+	//create function for block score state
+	auto heapstate = [this,&bs_lhvs_mapper]( t_idx_t b ) {
+		return bs_lhvs_mapper.map[this->blockstate(b)];
+	};
+	//create the initial heap
+	make_lheap( H.begin(), H.end(), blockcmp );
+
+	//// SEARCH FOR AN OPTIMAL BLOCK CHOICE ///////////////////////////////
+
+	block_choice bc; //best choice
+	bc.tbwt_benefit = tes.current_tbwt_gross_benefit();
+	bc.aux_tax = tes.current_aux_tax();
+	bc.tunnel_cnt = 0;
+
+	auto SB = H.rbegin(); //array to store sorted blocks
+
+	for (auto e = H.end(); e != H.begin(); ) {
+
+		auto b = H.front(); //get block with maximal score
+		tunnel_block_symbolic( b ); //symbolically tunnel block with best score
+
+		//remove block from heap, and store it in SB (similar to heapsort)
+		e = pop_lheap_nomove(H.begin(), e, heapstate, blockcmp);
+		*(SB++) = b;
+
+		//check if new encoding is smaller
+		auto current_tbwt_benefit = tes.current_tbwt_gross_benefit();
+		auto current_aux_tax = tes.current_aux_tax();
+		if (current_tbwt_benefit - bc.tbwt_benefit >=
+		    current_aux_tax - bc.aux_tax) {
+
+			bc.tbwt_benefit = current_tbwt_benefit;
+			bc.aux_tax = current_aux_tax;
+			bc.tunnel_cnt = distance( H.rbegin(), SB );
+		}
+	}
+	return bc;
+}
+
 //// TUNNEL A GIVEN BWT ///////////////////////////////////////////////////////
 
 template<class ttec>
-template<class Iterator>
-t_idx_t tunneling_support<ttec>::tunnel_bwt( t_string_t &bwt, twobitvector &aux, Iterator first, Iterator last ) {
-
-	//resize auxiliary bit vector to cover enough space
-	aux.resize( bwtrs.idx_n+1 );			
+void tunneling_support<ttec>::mark_tunnel( twobitvector &aux, t_idx_t b, std::vector<t_idx_t> &intervals ) {
+	//save which rows of block were not tunneled yet
+	intervals.clear();
+	auto lastaux = aux_encoding::REM;
+	for (t_idx_t i = bwtrs.log_to_idx(bwtrs.start(b)+1);
+	             i < bwtrs.log_to_idx(bwtrs.end(b)); i++) {
+		if (aux[i] != lastaux) {
+			lastaux = aux[i];
+			intervals.push_back( i - bwtrs.log_to_idx(bwtrs.start(b)) );
+		}
+	}
+	intervals.push_back( bwtrs.height(b) );
+
+	//prepare marking in aux
+	auto cur = bwtrs.run_lf(b);    //current run
+	auto last = bwtrs.start(b); //previous run (seen in text order)
+	while (cur != m_bns.end[b]) {
+		//clear cntL for all intervals in previous run
+		for (t_idx_t i = 1; i < intervals.size(); i += 2 ) {
+			aux.fill_or( bwtrs.log_to_idx(last + intervals[i-1]),   //interval start
+			             bwtrs.log_to_idx(last + intervals[i]  ),   //interval end
+			             aux_encoding::IGN_L );
+		}
 
-	//mark each tunnel in auxiliary structure
-	std::vector<t_idx_t> intervals;
-	while (first != last) {
-		auto b = *(first++);
-
-		//save which rows of block were not tunneled yet
-		intervals.clear();
-		auto lastaux = aux_encoding::REM;
-		for (t_idx_t i = bwtrs.log_to_idx(bwtrs.start(b)+1);
-		             i < bwtrs.log_to_idx(bwtrs.end(b)); i++) {
-			if (aux[i] != lastaux) {
-				lastaux = aux[i];
-				intervals.push_back( i - bwtrs.log_to_idx(bwtrs.start(b)) );
-			}
+		//move on cur and last by 1 column
+		last = cur;
+		t_idx_t cur_r = bwtrs.run_of( cur );
+		cur = (aux[bwtrs.log_to_idx( cur + intervals.front() )] == aux_encoding::IGN_L) //block of run cur_r was tunneled already
+		    ? m_bns.end[cur_r]    + (cur - bwtrs.start(cur_r))  //jump over block if tunneled already
+		    : bwtrs.run_lf(cur_r) + (cur - bwtrs.start(cur_r)); //otherwise proceed stepwise
+
+		//clear cntF for all intervals in current run (before both pointers were moved)
+		for (t_idx_t i = 1; i < intervals.size(); i += 2 ) {
+			aux.fill_or( bwtrs.log_to_idx(last + intervals[i-1]),
+			             bwtrs.log_to_idx(last + intervals[i]  ),
+			             aux_encoding::SKP_F );
 		}
-		intervals.push_back( bwtrs.height(b) );
-
-		//prepare marking in aux
-		auto cur = bwtrs.run_lf(b);    //current run
-		auto last = bwtrs.start(b); //previous run (seen in text order)
-		while (cur != m_bns.end[b]) {
-			//clear cntL for all intervals in previous run
-			for (t_idx_t i = 1; i < intervals.size(); i += 2 ) {
-				t_idx_t i_s = bwtrs.log_to_idx(last + intervals[i-1]); //interval start
-				t_idx_t i_e = bwtrs.log_to_idx(last + intervals[i]  ); //interval end
-				do {
-					aux[i_s] = aux[i_s] | aux_encoding::IGN_L;
-				} while (++i_s < i_e);
-			}
+	}
+	//set end of block b one position to right (i.e. one application of inverse LF),
+	// such that block jumping as shown above works correct
+	m_bns.set_end(b, last);
+}
 
-			//move on cur and last by 1 column
-			last = cur;
-			t_idx_t cur_r = bwtrs.run_of( cur );
-			cur = (aux[bwtrs.log_to_idx( cur + intervals.front() )] == aux_encoding::IGN_L) //block of run cur_r was tunneled already
-			    ? m_bns.end[cur_r]    + (cur - bwtrs.start(cur_r))  //jump over block if tunneled already
-			    : bwtrs.run_lf(cur_r) + (cur - bwtrs.start(cur_r)); //otherwise proceed stepwise
-
-			//clear cntF for all intervals in current run (before both pointers were moved)
-			for (t_idx_t i = 1; i < intervals.size(); i += 2 ) {
-				t_idx_t i_s = bwtrs.log_to_idx(last + intervals[i-1]);
-				t_idx_t i_e = bwtrs.log_to_idx(last + intervals[i]  );
-				do {
-					aux[i_s] = aux[i_s] | aux_encoding::SKP_F;
-				} while (++i_s < i_e);
-			}
+template<class ttec>
+void tunneling_support<ttec>::mark_tunnels_parallel( twobitvector &aux, const std::vector<t_idx_t> &blocks,
+                                                     unsigned threads ) {
+	//marking a block only touches rows of runs its columns pass through (including jumps over
+	// already tunneled blocks, which are nested in the same runs). Thus, blocks sharing no run
+	// can be marked independently, as long as the order of blocks sharing runs is kept.
+	// Additionally, runs whose rows share a 64-bit word of aux are owned by the same group.
+	const t_idx_t none = blocks.size();
+	std::vector<t_idx_t> parent( blocks.size() ); //union find over positions in blocks
+	std::vector<uint64_t> cost( blocks.size() );  //number of rows marked by each block
+	for (t_idx_t k = 0; k < blocks.size(); k++)	parent[k] = k;
+	auto find = [&parent]( t_idx_t k ) {
+		while (parent[k] != k) {
+			parent[k] = parent[parent[k]];
+			k = parent[k];
+		}
+		return k;
+	};
+	auto unite = [&parent,&find]( t_idx_t k1, t_idx_t k2 ) {
+		k1 = find(k1); k2 = find(k2);
+		if (k1 < k2)     	parent[k2] = k1;
+		else if (k2 < k1)	parent[k1] = k2;
+	};
+
+	//assign each run to the first block passing it
+	std::vector<t_idx_t> owner( bwtrs.runs, none );
+	for (t_idx_t k = 0; k < blocks.size(); k++) {
+		auto b = blocks[k];
+		t_idx_t r = b;
+		t_idx_t i = bwtrs.run_lf(b);
+		while (true) {
+			if (owner[r] == none)	owner[r] = k;
+			else                 	unite( owner[r], k );
+			cost[k] += bwtrs.height(b);
+			if (i == m_bns.end[b])	break;
+			r = bwtrs.run_of(i);
+			i = bwtrs.run_lf(r) + (i - bwtrs.start(r));
+		}
+	}
+	//unite owners of neighbouring runs which share a word in aux
+	t_idx_t pr = bwtrs.runs; //previous owned run
+	for (t_idx_t r = 0; r < bwtrs.runs; r++) {
+		if (owner[r] == none)	continue;
+		if (pr != bwtrs.runs && (bwtrs.log_to_idx(bwtrs.end(pr)-1) >> 5) == (bwtrs.log_to_idx(bwtrs.start(r)) >> 5)) {
+			unite( owner[pr], owner[r] );
+		}
+		pr = r;
+	}
+	std::vector<t_idx_t>().swap( owner );
+
+	//build groups, each preserving the order of its blocks
+	std::vector<std::vector<t_idx_t>> groups;
+	std::vector<uint64_t> gcost;
+	std::vector<t_idx_t> group_of( blocks.size() );
+	for (t_idx_t k = 0; k < blocks.size(); k++) {
+		auto root = find(k); //root is the first block of its group
+		if (root == k) {
+			group_of[k] = groups.size();
+			groups.emplace_back();
+			gcost.push_back( 0 );
 		}
-		//set end of block b one position to right (i.e. one application of inverse LF),
-		// such that block jumping as shown above works correct
-		m_bns.set_end(b, last);
+		groups[group_of[root]].push_back( blocks[k] );
+		gcost[group_of[root]] += cost[k];
 	}
+	std::vector<t_idx_t>().swap( parent );
+	std::vector<t_idx_t>().swap( group_of );
+
+	//process expensive groups first to balance load
+	std::vector<t_idx_t> order( groups.size() );
+	for (t_idx_t g = 0; g < order.size(); g++)	order[g] = g;
+	std::sort( order.begin(), order.end(), [&gcost]( t_idx_t g1, t_idx_t g2 ) {
+		return gcost[g1] > gcost[g2];
+	});
+
+	std::atomic<t_idx_t> next( 0 );
+	auto worker = [&]() {
+		std::vector<t_idx_t> intervals;
+		for (t_idx_t g = next++; g < order.size(); g = next++) {
+			for (auto b : groups[order[g]]) {
+				mark_tunnel( aux, b, intervals );
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	for (unsigned t = 1; t < threads; t++)	pool.emplace_back( worker );
+	worker();
+	for (auto &th : pool)	th.join();
+}
 
-	//remove doubly marked entries from BWT and auxiliary structure
-	t_idx_t bwt_idx;
-	t_idx_t borders[] = { bwtrs.bwt_idx, bwtrs.idx_n };
-	t_idx_t p = 0; //position in bwt and auxiliary data structure
-	t_idx_t i = 0; //position in original bwt
-	for (auto b : borders) {
-		bwt_idx = p; //also, compute new position of primary index
-		while (i < b) {
-			if (aux[i] != aux_encoding::REM) { //copy entries which won't be removed
-				bwt[p] = bwt[i];
-				aux[p++] = aux[i];
+template<class ttec>
+t_idx_t tunneling_support<ttec>::compact_tunneled_bwt( t_string_t &bwt, twobitvector &aux, unsigned threads ) const {
+	//new primary index is the number of remaining entries in front of the old one
+	t_idx_t bwt_idx = bwtrs.bwt_idx - aux.count( aux_encoding::REM, 0, std::min( bwtrs.bwt_idx, bwtrs.idx_n ) );
+	t_idx_t p; //position in bwt and auxiliary data structure
+	if (threads <= 1) {
+		//remove doubly marked entries from BWT and auxiliary structure
+		p = aux.compact( aux_encoding::REM, 0, bwtrs.idx_n, 0, bwt.begin() );
+	} else {
+		//compact word-aligned chunks in parallel, each to its own front
+		t_idx_t chunk = std::max( (t_idx_t)twobitvector::WORD_ENTRIES,
+		                          (t_idx_t)(((bwtrs.idx_n / threads) + 63) & ~(t_idx_t)63) );
+		t_idx_t chunks = (bwtrs.idx_n + chunk - 1) / chunk;
+		std::vector<t_idx_t> cnt( chunks );
+		std::atomic<t_idx_t> next( 0 );
+		auto worker = [&]() {
+			for (t_idx_t c = next++; c < chunks; c = next++) {
+				t_idx_t s = c * chunk;
+				cnt[c] = aux.compact( aux_encoding::REM, s, std::min( bwtrs.idx_n, s + chunk ), s, bwt.begin() );
 			}
-			++i;
+		};
+		std::vector<std::thread> pool;
+		for (unsigned t = 1; t < std::min( threads, (unsigned)chunks ); t++)	pool.emplace_back( worker );
+		worker();
+		for (auto &th : pool)	th.join();
+
+		//concatenate compacted chunks (which do not contain removable entries anymore)
+		p = 0;
+		for (t_idx_t c = 0; c < chunks; c++) {
+			p += aux.compact( aux_encoding::REM, c * chunk, c * chunk + cnt[c], p, bwt.begin() );
 		}
-	}	
+	}
 	//trim both bwt and aux to correct sizes and add a terminator to aux
 	bwt.resize( p );
 	aux[p++] = aux_encoding::REG;	aux.resize( p );
 	return bwt_idx;
 }
 
+template<class ttec>
+template<class Iterator>
+t_idx_t tunneling_support<ttec>::tunnel_bwt( t_string_t &bwt, twobitvector &aux, Iterator first, Iterator last,
+                                             unsigned threads ) {
+
+	//resize auxiliary bit vector to cover enough space
+	aux.resize( bwtrs.idx_n+1 );			
+
+	//mark each tunnel in auxiliary structure
+	if (threads > 1) {
+		mark_tunnels_parallel( aux, std::vector<t_idx_t>( first, last ), threads );
+	} else {
+		std::vector<t_idx_t> intervals;
+		while (first != last) {
+			mark_tunnel( aux, *(first++), intervals );
+		}
+	}
+
+	//remove doubly marked entries from BWT and auxiliary structure
+	return compact_tunneled_bwt( bwt, aux, threads );
+}
+
 //// INVERTING A TUNNELED BWT /////////////////////////////////////////////////
 
 template<class ttec>
@@ -287,9 +500,11 @@ void tunneling_support<ttec>::invert_tunneled_bwt( const t_string_t &tbwt, const
 	//count character frequencies
 	std::vector<t_size_t> C( maxalphval+1 );
 	for (t_idx_t i = 0; i < tbwt.size(); i++) {
-		if (aux[i] != aux_encoding::IGN_L) { //skip entries which are ignored
-			++C[tbwt[i]];
-		}
+		++C[tbwt[i]];
+	}
+	for (t_idx_t i = aux.find( aux_encoding::IGN_L ); i < tbwt.size();
+	             i = aux.find( aux_encoding::IGN_L, i+1 )) {
+		--C[tbwt[i]]; //skip entries which are ignored
 	}
 	//compute start positions
 	t_size_t j = 0;
@@ -314,7 +529,7 @@ void tunneling_support<ttec>::invert_tunneled_bwt( const t_string_t &tbwt, const
 	//// INVERTITION USING PHI ////////////////////////////////////////////
 	
 	//compute PHI
-	std::vector<t_idx_t> PHI( tbwt.size() );
+	t_idx_vector_t PHI( tbwt.size() );
 	for (t_idx_t i = 0; i < tbwt.size(); i++) {
 		if (aux[i] != aux_encoding::IGN_L) {
 			j = C[tbwt[i]];
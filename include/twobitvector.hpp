@@ -24,24 +24,39 @@
 #ifndef _TWOBITVECTOR_HPP
 #define _TWOBITVECTOR_HPP
 
+#include <algorithm>
 #include <assert.h>
 #include <stdint.h>
 #include <vector>
 
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+#if defined(__BMI2__)
+	#include <immintrin.h>
+#endif
+
 //! a simple implementation of a vector where each entry requires 2 bits.
+/*! entries are packed into 64-bit words (entry i is stored at bits 2*(i%32)
+   of word i/32), which allows bulk operations to process 32 entries at once.
+*/
 class twobitvector {
 	public:
 		typedef uint8_t                            value_type;
-		typedef std::vector<value_type>::size_type size_type;
+		typedef uint64_t                           word_type;
+		typedef std::vector<word_type>::size_type  size_type;
+
+		//! number of entries stored in one word of the underlying data field
+		static const size_type WORD_ENTRIES = 32;
 
 		//! reference type for twobitvector
 		class reference {
 			private:
-				value_type &val;
+				word_type &val;
 				value_type shift;
 			
 				friend class twobitvector;
-				reference( value_type &v, value_type s ) : val{v}, shift{s} {};
+				reference( word_type &v, value_type s ) : val{v}, shift{s} {};
 			public:
 				//! get value
 				operator value_type() const {
@@ -49,17 +64,65 @@ class twobitvector {
 				};
 				//! set value
 				reference& operator=(value_type v) {
-					val ^= (((val >> shift) ^ v) & 3u) << shift;
+					val ^= (((val >> shift) ^ v) & (word_type)3u) << shift;
 					return *this;
 				};
 				//! set value using another reference
 				reference& operator=(const reference& x) {
-					return *this=((x.val >> x.shift) & 3u);
+					return *this=(value_type)((x.val >> x.shift) & 3u);
 				};
 		};
 	private:
-		std::vector<value_type> m_data;
+		std::vector<word_type> m_data;
 		size_type m_size = 0;
+
+		static const word_type LO_BITS = 0x5555555555555555ull; //lower bit of each entry
+
+		//returns a word with each entry set to v
+		static word_type broadcast( value_type v ) {
+			return LO_BITS * (v & 3u);
+		};
+
+		//returns a mask covering entries [first..last) of a single word, 0 <= first < last <= 32
+		static word_type range_mask( size_type first, size_type last ) {
+			word_type m = (last == WORD_ENTRIES) ? ~(word_type)0 : ((word_type)1 << (last << 1)) - 1;
+			return m & ~(((word_type)1 << (first << 1)) - 1);
+		};
+
+		//returns the lower bit of each entry of word w which is equal to v
+		static word_type match( word_type w, value_type v ) {
+			w ^= broadcast( v );
+			return ~(w | (w >> 1)) & LO_BITS;
+		};
+
+		//packs the entries of w selected by the lower-bit mask m to the front of a word.
+		// pext is used only if the build targets BMI2 (e.g. make NATIVE=1), it is not
+		// selected at runtime because it is slow on some processors supporting it
+		static word_type pack( word_type w, word_type m ) {
+#if defined(__BMI2__)
+			return _pext_u64( w, m | (m << 1) );
+#else
+			word_type r = 0;
+			for (unsigned k = 0; m != 0; m &= m - 1, k += 2) {
+				r |= ((w >> __builtin_ctzll( m )) & 3u) << k;
+			}
+			return r;
+#endif
+		};
+
+		//writes the lowest 2*cnt bits of w to entries [i..i+cnt), cnt <= 32
+		void write_entries( size_type i, word_type w, size_type cnt ) {
+			if (cnt == 0)	return;
+			size_type wi = i / WORD_ENTRIES;
+			size_type o  = i % WORD_ENTRIES;
+			size_type c1 = (cnt < WORD_ENTRIES - o) ? cnt : WORD_ENTRIES - o;
+			word_type m1 = range_mask( o, o + c1 );
+			m_data[wi] = (m_data[wi] & ~m1) | ((w << (o << 1)) & m1);
+			if (c1 < cnt) {
+				word_type m2 = range_mask( 0, cnt - c1 );
+				m_data[wi+1] = (m_data[wi+1] & ~m2) | ((w >> (c1 << 1)) & m2);
+			}
+		};
 	
 	public:	
 		//! resize vector to the given size.
@@ -67,7 +130,10 @@ class twobitvector {
 		   is filled with zeros.
 		*/
 		void resize( size_type n ) {
-			m_data.resize( (n >> 2) + 1 );
+			m_data.resize( n / WORD_ENTRIES + 1 );
+			if (n < m_size) { //clear remaining entries, such that enlarging fills zeros
+				m_data[n / WORD_ENTRIES] &= range_mask( 0, n % WORD_ENTRIES );
+			}
 			m_size = n;
 		};
 
@@ -83,22 +149,153 @@ class twobitvector {
 
 		//! length of the underlying data field in bytes
 		size_type datasize() const {
-			return m_data.size();
+			return m_data.size() * sizeof(word_type);
 		};
 
 		//! random read access to the elements
 		value_type operator[]( size_type i ) const {
 			assert(i < m_size);
-			return (m_data[i >> 2] >> ((i & 3u) << 1)) & 3u;
+			return (m_data[i / WORD_ENTRIES] >> ((i % WORD_ENTRIES) << 1)) & 3u;
 		};
 
 		//! random read/write access to the elements
 		reference operator[]( size_type i ) {
 			assert(i < m_size);
-			return reference( m_data[i >> 2], (i & 3u) << 1 );
+			return reference( m_data[i / WORD_ENTRIES], (i % WORD_ENTRIES) << 1 );
 		};
 
-		//TODO: add more functions if required
+		//// BULK OPERATIONS ///////////////////////////////////////////////////
+
+		//! sets each entry in [first..last) to itself OR v.
+		void fill_or( size_type first, size_type last, value_type v ) {
+			assert(first <= last && last <= m_size);
+			if (first >= last)	return;
+			word_type b = broadcast( v );
+			size_type fw = first / WORD_ENTRIES, lw = (last-1) / WORD_ENTRIES;
+			if (fw == lw) {
+				m_data[fw] |= b & range_mask( first % WORD_ENTRIES, (last-1) % WORD_ENTRIES + 1 );
+				return;
+			}
+			m_data[fw] |= b & range_mask( first % WORD_ENTRIES, WORD_ENTRIES );
+			for (size_type w = fw+1; w < lw; w++)	m_data[w] |= b;
+			m_data[lw] |= b & range_mask( 0, (last-1) % WORD_ENTRIES + 1 );
+		};
+
+		//! sets each entry in [first..last) to v.
+		void fill( size_type first, size_type last, value_type v ) {
+			assert(first <= last && last <= m_size);
+			if (first >= last)	return;
+			word_type b = broadcast( v );
+			size_type fw = first / WORD_ENTRIES, lw = (last-1) / WORD_ENTRIES;
+			if (fw == lw) {
+				word_type m = range_mask( first % WORD_ENTRIES, (last-1) % WORD_ENTRIES + 1 );
+				m_data[fw] = (m_data[fw] & ~m) | (b & m);
+				return;
+			}
+			word_type m = range_mask( first % WORD_ENTRIES, WORD_ENTRIES );
+			m_data[fw] = (m_data[fw] & ~m) | (b & m);
+			std::fill( m_data.begin()+fw+1, m_data.begin()+lw, b );
+			m = range_mask( 0, (last-1) % WORD_ENTRIES + 1 );
+			m_data[lw] = (m_data[lw] & ~m) | (b & m);
+		};
+
+		//! returns the number of entries in [first..last) equal to v.
+		size_type count( value_type v, size_type first, size_type last ) const {
+			assert(first <= last && last <= m_size);
+			if (first >= last)	return 0;
+			size_type fw = first / WORD_ENTRIES, lw = (last-1) / WORD_ENTRIES;
+			if (fw == lw) {
+				return __builtin_popcountll( match( m_data[fw], v )
+				          & range_mask( first % WORD_ENTRIES, (last-1) % WORD_ENTRIES + 1 ) );
+			}
+			size_type c = __builtin_popcountll( match( m_data[fw], v ) & range_mask( first % WORD_ENTRIES, WORD_ENTRIES ) );
+			for (size_type w = fw+1; w < lw; w++) {
+				c += __builtin_popcountll( match( m_data[w], v ) );
+			}
+			return c + __builtin_popcountll( match( m_data[lw], v ) & range_mask( 0, (last-1) % WORD_ENTRIES + 1 ) );
+		};
+
+		//! returns the number of entries equal to v.
+		size_type count( value_type v ) const {
+			return count( v, 0, m_size );
+		};
+
+		//! returns the position of the first entry equal to v in [first..size()),
+		//! or size() if no such entry exists.
+		size_type find( value_type v, size_type first = 0 ) const {
+			if (first >= m_size)	return m_size;
+			size_type w = first / WORD_ENTRIES;
+			size_type lw = (m_size-1) / WORD_ENTRIES;
+			word_type m = match( m_data[w], v ) & range_mask( first % WORD_ENTRIES, WORD_ENTRIES );
+			while (m == 0 && w < lw) {
+#if defined(__SSE2__)
+				//skip two words at once while no entry matches
+				const __m128i b = _mm_set1_epi8( (char)broadcast( v ) );
+				const __m128i lo = _mm_set1_epi8( 0x55 );
+				while (w + 2 < lw) {
+					__m128i x = _mm_xor_si128( _mm_loadu_si128( (const __m128i *)&m_data[w+1] ), b );
+					x = _mm_andnot_si128( _mm_or_si128( x, _mm_srli_epi64( x, 1 ) ), lo );
+					if (_mm_movemask_epi8( _mm_cmpeq_epi8( x, _mm_setzero_si128() ) ) != 0xFFFF)	break;
+					w += 2;
+				}
+#endif
+				m = match( m_data[++w], v );
+			}
+			if (m == 0)	return m_size;
+			size_type p = w * WORD_ENTRIES + (__builtin_ctzll( m ) >> 1);
+			return (p < m_size) ? p : m_size;
+		};
+
+		//! returns the position of the first entry not equal to v in [first..size()),
+		//! or size() if no such entry exists.
+		size_type find_not( value_type v, size_type first = 0 ) const {
+			if (first >= m_size)	return m_size;
+			size_type w = first / WORD_ENTRIES;
+			size_type lw = (m_size-1) / WORD_ENTRIES;
+			word_type m = ~match( m_data[w], v ) & LO_BITS & range_mask( first % WORD_ENTRIES, WORD_ENTRIES );
+			while (m == 0 && w < lw) {
+				m = ~match( m_data[++w], v ) & LO_BITS;
+			}
+			if (m == 0)	return m_size;
+			size_type p = w * WORD_ENTRIES + (__builtin_ctzll( m ) >> 1);
+			return (p < m_size) ? p : m_size;
+		};
+
+		//! removes all entries in [first..last) equal to v and stores the remaining
+		//! entries consecutively starting at position dest (dest <= first must hold).
+		/*! the same removals are applied to the random access sequence payload, that is,
+		   payload[dest+k] is set to payload[i] if entry i is the k-th remaining entry.
+		   Returns the number of remaining entries.
+		*/
+		template<class RandomIt>
+		size_type compact( value_type v, size_type first, size_type last, size_type dest, RandomIt payload ) {
+			assert(dest <= first && first <= last && last <= m_size);
+			size_type p = dest;
+			size_type i = first;
+			while (i < last) {
+				size_type w  = i / WORD_ENTRIES;
+				size_type o  = i % WORD_ENTRIES;
+				size_type e  = (last - w * WORD_ENTRIES < WORD_ENTRIES) ? last - w * WORD_ENTRIES : WORD_ENTRIES;
+				word_type d  = m_data[w];
+				word_type keep = ~match( d, v ) & LO_BITS & range_mask( o, e );
+				size_type cnt = __builtin_popcountll( keep );
+				if (cnt == e - o) { //keep all entries
+					if (p != i) {
+						std::copy( payload + i, payload + (w * WORD_ENTRIES + e), payload + p );
+						write_entries( p, d >> (o << 1), cnt );
+					}
+				} else if (cnt != 0) {
+					word_type k = keep;
+					for (size_type q = p; k != 0; k &= k - 1) {
+						payload[q++] = payload[w * WORD_ENTRIES + (__builtin_ctzll( k ) >> 1)];
+					}
+					write_entries( p, pack( d, keep ), cnt );
+				}
+				p += cnt;
+				i = w * WORD_ENTRIES + e;
+			}
+			return p - dest;
+		};
 };
 
 #endif
@@ -21,8 +21,8 @@
  * SOFTWARE.
  */
 
-#ifndef BW94_COMPRESSOR_HPP
-#define BW94_COMPRESSOR_HPP
+#ifndef WT_COMPRESSOR_HPP
+#define WT_COMPRESSOR_HPP
 
 #include "bwt-compressor.hpp"
 #include "tbwt-compressor.hpp"
@@ -38,6 +38,9 @@
 //! class which encodes a BWT with a wavelet tree (and hybrid bitvectors) as second stage
 class BW_SS_WT : public block_scores_rle_model {
 public:
+	//! id of this second stage in the format tag of encodings (see block_compressor::format_id)
+	static const uint32_t FORMAT_ID = 3;
+
 	//! encodes the transform t using a wavelet tree
 	template<class T>
 	static void encode( T &t, std::ostream &out ) {
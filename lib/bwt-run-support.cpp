@@ -22,6 +22,7 @@
  */
 
 #include "bwt-run-support.hpp"
+#include "run-scanner.hpp"
 
 #include <algorithm>
 #include <limits>
@@ -44,18 +45,12 @@ bwt_run_support::bwt_run_support( const t_uchar_t *bwt, t_size_t _n, t_idx_t idx
 
 	//build C Array and count runs
 	vector<t_size_t> C( numeric_limits<t_uchar_t>::max() + 1 );
-	t_idx_t borders[] = {bwt_idx,idx_n};
-	t_idx_t i = 0;
-	for (t_idx_t b : borders) { //to split runs at primary index
-		t_uchar_t lastchar = (i < idx_n) ? bwt[i]+1 : 0;
-		while (i < b) {
-			if (lastchar != bwt[i]) { //start of a run
-				++m_idx_runs;
-				lastchar = bwt[i];
-			}
-			++C[lastchar];
-			++i;
-		}
+	t_idx_t borders[] = {0,bwt_idx,idx_n};
+	for (t_idx_t b = 0; b != 2; b++) { //to split runs at primary index
+		run_scanner::for_each_run( bwt, borders[b], borders[b+1], [&]( size_t i, size_t len ) {
+			++m_idx_runs;
+			C[bwt[i]] += len;
+		});
 	}
 	m_n = idx_n + 1;
 	m_runs = idx_runs + 1; //for bwt index
@@ -75,22 +70,15 @@ bwt_run_support::bwt_run_support( const t_uchar_t *bwt, t_size_t _n, t_idx_t idx
 	//compute LF
 	m_lfr.reserve( m_runs + 1 );
 	m_rs.reserve( m_runs + 1 );
-	i = 0;
-	t_idx_t i_log = 0; //logical position of i
-	for (t_idx_t b : borders) { //to split runs at primary index
-		t_uchar_t lastchar = (i < n) ? bwt[i]+1 : 0;
-		while (i < b) {
-			if (lastchar != bwt[i]) { //start of a run
-				m_rs.push_back( i_log ); //store start of run
-
-				lastchar = bwt[i];
-				m_lfr.push_back( C[lastchar] );
-			}
-			++C[lastchar];
-			++i; ++i_log;
-		}
+	for (t_idx_t b = 0; b != 2; b++) { //to split runs at primary index
+		t_idx_t shift = b; //logical position shift (0 before primary index, 1 behind)
+		run_scanner::for_each_run( bwt, borders[b], borders[b+1], [&]( size_t i, size_t len ) {
+			m_rs.push_back( i + shift ); //store start of run
+			m_lfr.push_back( C[bwt[i]] );
+			C[bwt[i]] += len;
+		});
 		//add a terminator to both lfr and rs (for both primary index and n)
-		m_rs.push_back( i_log++ );
+		m_rs.push_back( borders[b+1] + shift );
 		m_lfr.push_back( 0 );
 	}
 }
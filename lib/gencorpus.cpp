@@ -0,0 +1,449 @@
+/*
+ * gencorpus.cpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+//kinds of corpora which can be generated
+const char *KINDS[] = { "versions", "dna", "logs", "random", "zeros", "bindups" };
+
+//// RANDOMNESS ///////////////////////////////////////////////////////////////
+
+//pseudo random generator (xorshift64*), generating the same sequence on all platforms
+class rng {
+	private:
+		uint64_t s;
+	public:
+		rng( uint64_t seed ) {
+			//scramble seed using splitmix64, such that similar seeds yield different sequences
+			s = seed + 0x9E3779B97F4A7C15ull;
+			s = (s ^ (s >> 30)) * 0xBF58476D1CE4E5B9ull;
+			s = (s ^ (s >> 27)) * 0x94D049BB133111EBull;
+			s ^= s >> 31;
+			if (s == 0)	s = 1;
+		};
+
+		//! returns the next random number
+		uint64_t next() {
+			s ^= s >> 12;
+			s ^= s << 25;
+			s ^= s >> 27;
+			return s * 0x2545F4914F6CDD1Dull;
+		};
+
+		//! returns a random number in [0,n)
+		uint64_t below( uint64_t n ) {
+			return next() % n;
+		};
+
+		//! returns a random number in [0,n), smaller numbers being more likely (roughly zipfian)
+		uint64_t skewed( uint64_t n ) {
+			return below( below(n) + 1 );
+		};
+
+		//! returns a random number in (0,1]
+		double unit() {
+			return ((next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+		};
+
+		//! returns the number of trials before the first success, if each trial succeeds with probability p
+		uint64_t gap( double p ) {
+			if (p >= 1)	return 0;
+			if (p <= 0)	return UINT64_MAX;
+			double g = log( unit() ) / log1p( -p );
+			return (g >= 1e18) ? UINT64_MAX : (uint64_t)g;
+		};
+};
+
+//copies src to dst, where each symbol of src starts an edit with probability rate.
+//An edit either substitutes a symbol, inserts or deletes 1 up to maxlen symbols;
+//new symbols are obtained from fresh
+template<class T, class F>
+void mutate( const vector<T> &src, vector<T> &dst, double rate, uint64_t maxlen, rng &r, F fresh ) {
+	dst.clear();
+	dst.reserve( src.size() + src.size() / 16 );
+	uint64_t i = 0;
+	while (i < src.size()) {
+		uint64_t copy = min<uint64_t>( r.gap(rate), src.size() - i );
+		dst.insert( dst.end(), src.begin() + i, src.begin() + i + copy );
+		i += copy;
+		if (i == src.size()) {
+			break;
+		}
+		uint64_t len = 1 + r.below( maxlen );
+		switch (r.below(3)) {
+			case 0: dst.push_back( fresh() ); i++; break; //substitution
+			case 1: while (len--) dst.push_back( fresh() ); break; //insertion
+			default: i += min<uint64_t>( len, src.size() - i ); //deletion
+		}
+	}
+}
+
+//creates a vocabulary of words consisting of lowercase letters
+vector<string> makeVocabulary( size_t words, rng &r ) {
+	vector<string> voc( words );
+	for (auto &w : voc) {
+		size_t len = 2 + r.skewed( 10 );
+		for (size_t k = 0; k < len; k++) {
+			w += (char)('a' + r.skewed( 26 ));
+		}
+	}
+	return voc;
+}
+
+//// OUTPUT ///////////////////////////////////////////////////////////////////
+
+//output file which accepts characters until a given size is reached
+class corpus_writer {
+	private:
+		ofstream out;
+		uint64_t m_left;
+	public:
+		corpus_writer( const string &file, uint64_t size ) : out{ file, ofstream::binary | ofstream::trunc },
+				m_left{ size } {
+			if (!out) {
+				throw invalid_argument("unable to open file \"" + file + "\"");
+			}
+		};
+
+		//! returns the number of characters which still can be written
+		uint64_t left() const {
+			return m_left;
+		};
+
+		//! writes up to n characters of data
+		void write( const void *data, uint64_t n ) {
+			n = min( n, m_left );
+			out.write( (const char *)data, n );
+			m_left -= n;
+			if (!out) {
+				throw runtime_error("unable to write output");
+			}
+		};
+		void write( const string &s ) {
+			write( s.data(), s.size() );
+		};
+};
+
+//// GENERATORS ///////////////////////////////////////////////////////////////
+
+//versions of a text document, each word of a version is edited with probability rate
+void genVersions( corpus_writer &w, double rate, rng &r ) {
+	const size_t WORDS = 32*1024; //words of a version, i.e. roughly 200 KB
+	const uint32_t NEWLINE = 0; //word id of a line break
+	vector<string> voc = makeVocabulary( 8192, r );
+	auto fresh = [&r,&voc]() {
+		return r.below(12) == 0 ? NEWLINE : (uint32_t)(1 + r.skewed( voc.size() - 1 ));
+	};
+	vector<uint32_t> doc, next;
+	for (size_t k = 0; k < WORDS; k++) {
+		doc.push_back( fresh() );
+	}
+	string text;
+	while (w.left() > 0) {
+		text.clear();
+		for (auto id : doc) {
+			if (id == NEWLINE) {
+				text += '\n';
+			} else {
+				text += voc[id];
+				text += ' ';
+			}
+		}
+		text += "\n\n";
+		w.write( text );
+		mutate( doc, next, rate, 8, r, fresh );
+		doc.swap( next );
+	}
+}
+
+//variants of a genome over ACGT, each base of a variant is edited with probability rate
+void genDNA( corpus_writer &w, double rate, rng &r ) {
+	const size_t BASES = 4*1024*1024; //length of the genome
+	const char ACGT[] = { 'A', 'C', 'G', 'T' };
+	auto fresh = [&r,&ACGT]() {
+		return ACGT[r.below(4)];
+	};
+	vector<char> genome, next;
+	for (size_t k = 0; k < BASES; k++) {
+		genome.push_back( fresh() );
+	}
+	while (w.left() > 0) {
+		w.write( genome.data(), genome.size() );
+		mutate( genome, next, rate, 8, r, fresh );
+		genome.swap( next );
+	}
+}
+
+//lines of a log, produced by a fixed set of templates. Each variable field obtains
+//a new value with probability rate, and otherwise reuses one of a few values
+void genLogs( corpus_writer &w, double rate, rng &r ) {
+	const size_t TEMPLATES = 64, FIELDS = 6, POOL = 16;
+	const char *LEVELS[] = { "INFO", "DEBUG", "WARN", "ERROR" };
+	vector<string> voc = makeVocabulary( 1024, r );
+
+	//a template consists of words and fields, where a field is marked by its type (1 to FIELDS)
+	auto freshValue = [&r,&voc]( int type ) {
+		string v;
+		switch (type) {
+			case 1: v = to_string( r.skewed(100000) ); break; //number
+			case 2: for (int k = 0; k < 4; k++) v += (k ? "." : "") + to_string( r.below(256) ); break; //ip
+			case 3: for (int k = 0; k < 16; k++) v += "0123456789abcdef"[r.below(16)]; break; //id
+			case 4: v = voc[r.skewed( voc.size() )]; break; //word
+			case 5: for (int k = 1 + r.below(4); k > 0; k--) v += "/" + voc[r.skewed( voc.size() )]; break; //path
+			default: v = to_string( r.below(1000) ) + "ms"; //duration
+		}
+		return v;
+	};
+	vector<vector<int>> templates( TEMPLATES );
+	for (auto &t : templates) {
+		for (size_t k = 3 + r.below(10); k > 0; k--) {
+			t.push_back( r.below(3) == 0 ? -(int)(1 + r.below(FIELDS)) : (int)r.skewed( voc.size() ) );
+		}
+	}
+	vector<vector<string>> pool( FIELDS+1 );
+	for (int type = 1; type <= (int)FIELDS; type++) {
+		for (size_t k = 0; k < POOL; k++) {
+			pool[type].push_back( freshValue( type ) );
+		}
+	}
+
+	uint64_t millis = 0; //time since the start of the log
+	string line;
+	while (w.left() > 0) {
+		millis += r.skewed( 2000 );
+		uint64_t sec = millis / 1000;
+		char stamp[32];
+		snprintf( stamp, sizeof(stamp), "2017-%02u-%02u %02u:%02u:%02u.%03u", (unsigned)(1 + sec / 2419200 % 12),
+		          (unsigned)(1 + sec / 86400 % 28), (unsigned)(sec / 3600 % 24), (unsigned)(sec / 60 % 60),
+		          (unsigned)(sec % 60), (unsigned)(millis % 1000) );
+		line = stamp;
+		line += " [";
+		line += LEVELS[r.skewed(4)];
+		line += "]";
+		for (int token : templates[r.skewed( TEMPLATES )]) {
+			line += ' ';
+			if (token >= 0) {
+				line += voc[token];
+			} else if (r.unit() <= rate) {
+				line += freshValue( -token );
+			} else {
+				line += pool[-token][r.skewed( POOL )];
+			}
+		}
+		line += '\n';
+		w.write( line );
+	}
+}
+
+//uniformly distributed bytes
+void genRandom( corpus_writer &w, rng &r ) {
+	vector<uint64_t> buf( 1 << 16 );
+	while (w.left() > 0) {
+		for (auto &v : buf) {
+			v = r.next();
+		}
+		w.write( buf.data(), buf.size() * sizeof(uint64_t) );
+	}
+}
+
+//long runs of zeros, interrupted by random bytes, which make up a fraction rate of the output
+void genZeros( corpus_writer &w, double rate, rng &r ) {
+	const uint64_t RUN = 64*1024; //mean length of a zero run
+	const double SEGMENT = (rate >= 1) ? 1e18 : RUN * rate / (1 - rate); //mean length of a random segment
+	vector<char> zeros( 2*RUN ), rnd;
+	while (w.left() > 0) {
+		if (rate < 1) {
+			w.write( zeros.data(), r.below( 2*RUN ) + 1 );
+		}
+		uint64_t len = min<uint64_t>( (uint64_t)(r.unit() * 2 * SEGMENT), w.left() );
+		rnd.resize( len );
+		for (auto &c : rnd) {
+			c = (char)r.next();
+		}
+		w.write( rnd.data(), rnd.size() );
+	}
+}
+
+//builds of a binary, where each byte of a build is edited with probability rate
+void genBinDups( corpus_writer &w, double rate, rng &r ) {
+	const size_t SIZE = 4*1024*1024; //size of the binary
+	vector<string> voc = makeVocabulary( 2048, r );
+	vector<unsigned char> opcodes( 64 );
+	for (auto &o : opcodes) {
+		o = (unsigned char)r.next();
+	}
+
+	//binary consists of sections of code, tables, strings and padding
+	vector<unsigned char> bin, next;
+	while (bin.size() < SIZE) {
+		uint64_t len = 256 + r.below( 16*1024 );
+		switch (r.below(4)) {
+			case 0: { //table of ascending little endian integers
+				uint32_t v = (uint32_t)r.next();
+				for (uint64_t k = 0; k < len / 4; k++, v += (uint32_t)r.skewed(256)) {
+					for (int b = 0; b < 32; b += 8)	bin.push_back( (unsigned char)(v >> b) );
+				}
+				break;
+			}
+			case 1: //zero terminated strings
+				for (uint64_t k = 0; k < len / 8; k++) {
+					const string &s = voc[r.skewed( voc.size() )];
+					bin.insert( bin.end(), s.begin(), s.end() );
+					bin.push_back( 0 );
+				}
+				break;
+			case 2: //padding
+				bin.insert( bin.end(), len / 16, 0 );
+				break;
+			default: //code with skewed opcodes and random operands
+				for (uint64_t k = 0; k < len; k++) {
+					bin.push_back( (k % 3 == 0) ? opcodes[r.skewed( opcodes.size() )] : (unsigned char)r.next() );
+				}
+		}
+	}
+	auto fresh = [&r]() {
+		return (unsigned char)r.next();
+	};
+	while (w.left() > 0) {
+		w.write( bin.data(), bin.size() );
+		mutate( bin, next, rate, 16, r, fresh );
+		bin.swap( next );
+	}
+}
+
+//// USER INTERFACE ///////////////////////////////////////////////////////////
+
+void printUsage(const char *cmd) {
+	cerr << "usage: " << cmd << " [SEED] [RATE] KIND SIZE OUTFILE" << endl;
+	cerr << "\tgenerates a synthetic test file deterministically, i.e. equal arguments" << endl;
+	cerr << "\tproduce equal files" << endl;
+	cerr << "\tSEED: -s N to seed the random generator with N (default 0)" << endl;
+	cerr << "\tRATE: -m R to tune repetitiveness, smaller rates yield more repetitive files." << endl;
+	cerr << "\t      meaning and default depend on KIND (see below), random ignores RATE" << endl;
+	cerr << "\tKIND: type of the file, one of" << endl;
+	cerr << "\t      versions: versions of a text document, each version edits a word of" << endl;
+	cerr << "\t                its predecessor with probability RATE (default 0.001)" << endl;
+	cerr << "\t      dna: variants of a 4 MB genome over ACGT, each variant edits a base of" << endl;
+	cerr << "\t           its predecessor with probability RATE (default 0.001)" << endl;
+	cerr << "\t      logs: log lines built from templates, where variable fields obtain" << endl;
+	cerr << "\t            a new value with probability RATE (default 0.05)" << endl;
+	cerr << "\t      random: uniformly distributed bytes" << endl;
+	cerr << "\t      zeros: long zero runs, interrupted by random bytes making up a" << endl;
+	cerr << "\t             fraction RATE of the file (default 0.01)" << endl;
+	cerr << "\t      bindups: builds of a 4 MB binary, each build edits a byte of its" << endl;
+	cerr << "\t               predecessor with probability RATE (default 0.0005)" << endl;
+	cerr << "\tSIZE: size of the file in bytes, units K, M and G are allowed (e.g. 100M)" << endl;
+	cerr << "\tOUTFILE: path to resulting file" << endl;
+}
+
+//parses a size with an optional unit, returns 0 if invalid
+long long parseSize(const string &s) {
+	char *unit = NULL;
+	long long size = strtoll(s.c_str(), &unit, 10);
+	if (unit != NULL && *unit != '\0') {
+		switch (*(unit++)) {
+			case 'G': size <<= 10; //fall through
+			case 'M': size <<= 10; //fall through
+			case 'K': size <<= 10; break;
+			default:  size = 0;
+		}
+		if (*unit != '\0')	size = 0;
+	}
+	return size;
+}
+
+int main( int argc, char **argv ) {
+	//analyse args
+	uint64_t seed = 0;
+	double rate = -1;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-s") == 0 && i+1 < argc) { //seed
+			seed = strtoull(argv[++i], nullptr, 10);
+		}
+		else if (strcmp(argv[i], "-m") == 0 && i+1 < argc) { //rate
+			rate = atof(argv[++i]);
+			if (rate < 0 || rate > 1) {
+				printUsage(argv[0]);
+				cerr << "Rate must be between 0 and 1!" << endl;
+				return 1;
+			}
+		}
+		else {
+			printUsage(argv[0]);
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+	if (argc - i != 3) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	string kind = argv[i++];
+	long long size = parseSize( argv[i++] );
+	string outfile = argv[i];
+	if (find(begin(KINDS), end(KINDS), kind) == end(KINDS)) {
+		printUsage(argv[0]);
+		cerr << "Unknown kind " << kind << endl;
+		return 1;
+	}
+	if (size <= 0) {
+		printUsage(argv[0]);
+		cerr << "Invalid size!" << endl;
+		return 1;
+	}
+
+	//generate
+	try {
+		rng r( seed );
+		corpus_writer w( outfile, size );
+		if (kind == "versions")     genVersions( w, rate < 0 ? 0.001 : rate, r );
+		else if (kind == "dna")     genDNA( w, rate < 0 ? 0.001 : rate, r );
+		else if (kind == "logs")    genLogs( w, rate < 0 ? 0.05 : rate, r );
+		else if (kind == "random")  genRandom( w, r );
+		else if (kind == "zeros")   genZeros( w, rate < 0 ? 0.01 : rate, r );
+		else                        genBinDups( w, rate < 0 ? 0.0005 : rate, r );
+	} catch ( invalid_argument &e ) {
+		printUsage( argv[0] );
+		cerr << "Invalid argument: " << e.what() << endl;
+		return 1;
+	} catch ( runtime_error &e ) {
+		cerr << "Runtime error: " << e.what() << endl;
+		return 1;
+	} catch ( exception &e ) {
+		cerr << "Exception: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
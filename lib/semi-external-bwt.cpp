@@ -0,0 +1,123 @@
+/*
+ * semi-external-bwt.cpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "semi-external-bwt.hpp"
+
+#include <sdsl/construct_sa_se.hpp>
+#include <sdsl/int_vector.hpp>
+#include <sdsl/int_vector_buffer.hpp>
+#include <sdsl/io.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+saidx_t semi_external_bwt( t_string_t &S, const string &dir ) {
+	const t_size_t n = S.size();
+	const uint64_t BUFFER_SIZE = 1024*1024;
+	if (n < 2) { //too short for construct_sa_se
+		saidx_t SA[2];
+		return divbwt( S.data(), S.data(), SA, (saidx_t)n );
+	}
+
+	//scratch files, which are removed also if construction fails
+	struct scratch_files {
+		string text, sa, bwt;
+		~scratch_files() {
+			remove( text.c_str() ); remove( sa.c_str() ); remove( bwt.c_str() );
+		};
+	} files;
+	files.text = sdsl::tmp_file( dir + "/tbwt", "_text" );
+	files.sa   = sdsl::tmp_file( dir + "/tbwt", "_sa" );
+	files.bwt  = sdsl::tmp_file( dir + "/tbwt", "_bwt" );
+
+	//move text to disk
+	{
+		ofstream f( files.text, ios::binary | ios::trunc );
+		f.write( (const char *)S.data(), n );
+		if (!f) {
+			throw runtime_error( "unable to write scratch file " + files.text );
+		}
+	}
+	t_string_t().swap( S );
+
+	//construct suffix array of text shifted by one, followed by sentinel 0
+	{
+		sdsl::int_vector<> text( n+1, 0, 9 );
+		ifstream f( files.text, ios::binary );
+		vector<char> buf( BUFFER_SIZE );
+		for (t_size_t i = 0; i < n; i += buf.size()) {
+			auto len = min( (t_size_t)buf.size(), n - i );
+			f.read( buf.data(), len );
+			for (t_size_t j = 0; j < len; j++)	text[i+j] = (uint8_t)buf[j] + 1;
+		}
+		if (!f) {
+			throw runtime_error( "unable to read scratch file " + files.text );
+		}
+		sdsl::_construct_sa_se<sdsl::int_vector<>>( text, files.sa, 257, 0 );
+	}
+
+	//stream suffix array to compute bwt (without sentinel) on disk
+	saidx_t idx = 0;
+	{
+		S.resize( n );
+		ifstream f( files.text, ios::binary );
+		f.read( (char *)S.data(), n );
+		sdsl::int_vector_buffer<> sa( files.sa, ios::in, BUFFER_SIZE );
+		if (!f || sa.size() != (uint64_t)n+1) {
+			throw runtime_error( "semi-external suffix array construction failed" );
+		}
+		ofstream out( files.bwt, ios::binary | ios::trunc );
+		vector<char> buf;
+		buf.reserve( BUFFER_SIZE );
+		for (uint64_t i = 0; i <= n; i++) {
+			uint64_t p = sa[i];
+			if (p == 0) {
+				idx = i;
+			} else {
+				buf.push_back( S[p-1] );
+			}
+			if (buf.size() == BUFFER_SIZE || i == n) {
+				out.write( buf.data(), buf.size() );
+				buf.clear();
+			}
+		}
+		if (!out) {
+			throw runtime_error( "unable to write scratch file " + files.bwt );
+		}
+	}
+
+	//load bwt
+	ifstream f( files.bwt, ios::binary );
+	f.read( (char *)S.data(), n );
+	if (!f) {
+		throw runtime_error( "unable to read scratch file " + files.bwt );
+	}
+	return idx;
+}
@@ -0,0 +1,523 @@
+/*
+ * stagebench.cpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+#include <sys/resource.h>
+#include <vector>
+
+#include "bcm-compressor.hpp"
+#include "bw94-compressor.hpp"
+#include "huf-compressor.hpp"
+#include "metrics-sink.hpp"
+#include "perf-counters.hpp"
+#include "wt-compressor.hpp"
+
+using namespace std;
+
+//stages of the tunneled bwt pipeline in order of execution, named like the durations
+// recorded by tbwt_compressor (without " time")
+enum stage_id { BWT, BLOCK_COMPUTATION, BLOCK_CHOICE, TUNNELING, ENCODING, DECODING, INVERSION, STAGES };
+const char *STAGE_NAMES[STAGES] = { "bwt construction", "block computation", "block choice", "tunneling",
+                                    "encoding", "decoding", "tbwt inversion" };
+
+//known second stages, identified by the suffix of their tunneled compressor
+const char *BACKENDS[] = { "tbwz", "tbcm", "twt", "thuf" };
+
+//measurements of a single stage over all runs
+struct stage_stats {
+	vector<double> seconds; //time of each run
+	uint64_t peak = 0; //maximal peak resident memory of the process during the stage
+	uint64_t peak_delta = 0; //maximal peak resident memory on top of the memory used before the stage
+	vector<uint64_t> events[perf_counters::EVENTS]; //hardware events of each run, if available
+};
+
+//whether hardware events are counted for each stage
+bool countEvents = false;
+
+//// MEMORY MEASUREMENT ///////////////////////////////////////////////////////
+
+//whether the peak resident memory can be reset, otherwise peaks are lifetime peaks
+bool peakResettable = true;
+
+//returns a memory entry (in bytes) of /proc/self/status, or 0 if it is not available
+uint64_t readStatus(const string &key) {
+	ifstream status{ "/proc/self/status" };
+	string line;
+	while (getline(status, line)) {
+		if (line.compare(0, key.size(), key) == 0) {
+			return strtoull(line.c_str() + key.size(), nullptr, 10) * 1024;
+		}
+	}
+	return 0;
+}
+
+//resets the peak resident memory of this process, returns the current resident memory
+uint64_t resetPeakMemory() {
+	if (peakResettable) {
+		ofstream clear{ "/proc/self/clear_refs" };
+		peakResettable = (bool)(clear << "5" << flush);
+		if (!peakResettable) {
+			cerr << "warning: unable to reset peak memory, peaks are lifetime peaks" << endl;
+		}
+	}
+	return readStatus("VmRSS:");
+}
+
+//returns the peak resident memory of this process since the last reset
+uint64_t peakMemory() {
+	uint64_t peak = readStatus("VmHWM:");
+	if (peak == 0) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		peak = (uint64_t)usage.ru_maxrss * 1024;
+	}
+	return peak;
+}
+
+//// STAGE BENCHMARK //////////////////////////////////////////////////////////
+
+//output stream buffer discarding all characters, but counting them
+class counting_buf : public streambuf {
+	public:
+		uint64_t count = 0;
+	protected:
+		virtual int_type overflow(int_type c) {
+			count++;
+			return c;
+		}
+		virtual streamsize xsputn(const char *, streamsize n) {
+			count += n;
+			return n;
+		}
+};
+
+//sink taking the measurements of each stage from the metrics of a compressor: durations
+// and hardware events are recorded by the compressor itself, the peak resident memory of a
+// stage is measured from the end of the previous duration recorded up to its own
+class stage_sink : public metrics_sink {
+	private:
+		vector<stage_stats> &stats;
+		uint64_t before; //resident memory at the end of the previous duration
+		mutex m;
+
+		//returns the stage whose metric key is stage name followed by suffix, or STAGES
+		static unsigned stage_of(const string &key, const string &suffix) {
+			for (unsigned s = 0; s < STAGES; s++) {
+				if (key == STAGE_NAMES[s] + suffix)	return s;
+			}
+			return STAGES;
+		}
+	public:
+		stage_sink(vector<stage_stats> &st) : stats(st) {
+			before = resetPeakMemory();
+		}
+
+		virtual void record(const metric_record &r) {
+			lock_guard<mutex> lock(m);
+			if (r.type == metric_record::DURATION) {
+				unsigned s = stage_of(r.key, " time");
+				if (s < STAGES) {
+					uint64_t peak = peakMemory();
+					stats[s].seconds.push_back(r.value / 1e9);
+					stats[s].peak = max(stats[s].peak, peak);
+					stats[s].peak_delta = max(stats[s].peak_delta, peak > before ? peak - before : 0);
+				}
+				before = resetPeakMemory();
+			} else if (r.type == metric_record::COUNT) {
+				for (unsigned e = 0; e < perf_counters::EVENTS; e++) {
+					unsigned s = stage_of(r.key, string(" ") + perf_counters::name( (perf_counters::event_t)e ));
+					if (s < STAGES)	stats[s].events[e].push_back( r.value );
+				}
+			}
+		}
+};
+
+//compresses and decompresses T runs times with the tunneled compressor using second stage
+// t_ss_e (as a single block), and collects the measurements of its stages
+template<class t_ss_e>
+void benchStages(const t_string_t &T, unsigned runs, unsigned threads, vector<stage_stats> &stats) {
+	const t_size_t n = T.size();
+	stats.assign(STAGES, stage_stats());
+
+	tbwt_compressor<t_ss_e> c;
+	c.set_block_size( max<streamsize>( n, 1 ) );
+	c.set_threads( threads );
+	c.set_perf_counters( countEvents );
+	c.set_metrics_sink( make_shared<stage_sink>( stats ) );
+
+	const string text( T.begin(), T.end() );
+	for (unsigned r = 0; r < runs; r++) {
+		string enc;
+		{
+			istringstream in( text );
+			ostringstream out;
+			c.compress( in, out );
+			enc = out.str();
+		}
+		istringstream in( enc );
+		counting_buf cb;
+		ostream out( &cb );
+		c.decompress( in, out );
+		if (cb.count != n) {
+			throw runtime_error("decompressed text has wrong length");
+		}
+	}
+}
+
+//runs the stage benchmark of the given backend, returns false if backend is unknown
+bool benchBackend(const string &backend, const t_string_t &T, unsigned runs, unsigned threads,
+                  vector<stage_stats> &stats) {
+	if (backend == "tbwz") benchStages<BW_SS_BW94>( T, runs, threads, stats );
+	else if (backend == "tbcm") benchStages<BW_SS_BCM>( T, runs, threads, stats );
+	else if (backend == "twt") benchStages<BW_SS_WT>( T, runs, threads, stats );
+	else if (backend == "thuf") benchStages<BW_SS_HUF>( T, runs, threads, stats );
+	else return false;
+	return true;
+}
+
+//// JSON IN- AND OUTPUT //////////////////////////////////////////////////////
+
+//result of a stage, as written to (or read from) json
+struct stage_result {
+	string file;
+	string backend;
+	string stage;
+	uint64_t bytes;
+	double median_mbps;
+	double p95_mbps;
+	uint64_t peak_bytes;
+	uint64_t peak_delta_bytes;
+	int64_t events[perf_counters::EVENTS]; //median hardware events, or -1 if not counted
+};
+
+//summarizes the measurements of a stage, which processed bytes many input bytes per run
+stage_result summarize(const string &file, const string &backend, const string &stage, uint64_t bytes,
+                       stage_stats &s) {
+	const double MB = 1024.0 * 1024.0;
+	sort(s.seconds.begin(), s.seconds.end());
+	size_t r = s.seconds.size();
+	double median = (r % 2 == 1) ? s.seconds[r/2] : (s.seconds[r/2-1] + s.seconds[r/2]) / 2;
+	double p95 = s.seconds[(r*95 + 99) / 100 - 1]; //nearest rank, i.e. slowest 5% of runs excluded
+	auto mbps = [&](double sec) { return bytes / MB / max(sec, 1e-9); };
+	stage_result res{ file, backend, stage, bytes, mbps(median), mbps(p95), s.peak, s.peak_delta, {} };
+	for (unsigned e = 0; e < perf_counters::EVENTS; e++) {
+		vector<uint64_t> &v = s.events[e];
+		sort(v.begin(), v.end());
+		res.events[e] = (v.size() < r) ? -1 : (int64_t)v[r/2]; //counted in every run only
+	}
+	return res;
+}
+
+//escapes a string for json
+string jsonEscape(const string &s) {
+	string e;
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			e += '\\';
+			e += c;
+		} else if ((unsigned char)c < 0x20) {
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			e += buf;
+		} else {
+			e += c;
+		}
+	}
+	return e;
+}
+
+//writes the results as json, one result per line
+void writeJson(const vector<stage_result> &results, unsigned runs, ostream &out) {
+	out << "{\"runs\": " << runs << ", \"results\": [" << endl;
+	out << fixed << setprecision(3);
+	for (size_t i = 0; i < results.size(); i++) {
+		const stage_result &r = results[i];
+		out << "{\"file\": \"" << jsonEscape(r.file) << "\", \"backend\": \"" << r.backend
+		    << "\", \"stage\": \"" << r.stage << "\", \"bytes\": " << r.bytes
+		    << ", \"median_mbps\": " << r.median_mbps << ", \"p95_mbps\": " << r.p95_mbps
+		    << ", \"peak_bytes\": " << r.peak_bytes << ", \"peak_delta_bytes\": " << r.peak_delta_bytes;
+		for (unsigned e = 0; countEvents && e < perf_counters::EVENTS; e++) {
+			string key = perf_counters::name( (perf_counters::event_t)e );
+			replace(key.begin(), key.end(), ' ', '_');
+			out << ", \"" << key << "\": ";
+			if (r.events[e] < 0)	out << "null";
+			else	out << r.events[e];
+		}
+		out << "}" << (i+1 < results.size() ? "," : "") << endl;
+	}
+	out << "]}" << endl;
+}
+
+//returns the position after "key": in line, or string::npos if key is missing
+size_t jsonValuePos(const string &line, const string &key) {
+	size_t p = line.find("\"" + key + "\":");
+	return (p == string::npos) ? p : line.find_first_not_of(" ", p + key.size() + 3);
+}
+
+//reads the string value of key in line
+string jsonString(const string &line, const string &key) {
+	size_t p = jsonValuePos(line, key);
+	string s;
+	if (p == string::npos || line[p] != '"') {
+		throw invalid_argument("missing string \"" + key + "\" in baseline");
+	}
+	for (p++; p < line.size() && line[p] != '"'; p++) {
+		if (line[p] == '\\' && p+1 < line.size()) {
+			p++;
+			if (line[p] == 'u' && p+4 < line.size()) {
+				s += (char)strtoul(line.substr(p+1, 4).c_str(), nullptr, 16);
+				p += 4;
+				continue;
+			}
+		}
+		s += line[p];
+	}
+	return s;
+}
+
+//reads the numeric value of key in line
+double jsonNumber(const string &line, const string &key) {
+	size_t p = jsonValuePos(line, key);
+	if (p == string::npos) {
+		throw invalid_argument("missing number \"" + key + "\" in baseline");
+	}
+	return strtod(line.c_str() + p, nullptr);
+}
+
+//reads results written by writeJson
+vector<stage_result> readJson(istream &in) {
+	vector<stage_result> results;
+	string line;
+	while (getline(in, line)) {
+		if (jsonValuePos(line, "stage") == string::npos) {
+			continue;
+		}
+		results.push_back( stage_result{ jsonString(line, "file"), jsonString(line, "backend"),
+		                   jsonString(line, "stage"), (uint64_t)jsonNumber(line, "bytes"),
+		                   jsonNumber(line, "median_mbps"), jsonNumber(line, "p95_mbps"),
+		                   (uint64_t)jsonNumber(line, "peak_bytes"),
+		                   (uint64_t)jsonNumber(line, "peak_delta_bytes"), {} } );
+	}
+	return results;
+}
+
+//compares results against a baseline, reports regressions beyond tolerance to err.
+//Returns the number of regressions.
+size_t compareBaseline(const vector<stage_result> &results, const vector<stage_result> &baseline,
+                       double tolerance, ostream &err) {
+	map<string, const stage_result *> base;
+	for (auto &b : baseline) {
+		base[b.file + '\0' + b.backend + '\0' + b.stage] = &b;
+	}
+	size_t compared = 0, regressions = 0;
+	err << fixed << setprecision(1);
+	for (auto &r : results) {
+		auto it = base.find(r.file + '\0' + r.backend + '\0' + r.stage);
+		if (it == base.end()) {
+			continue;
+		}
+		const stage_result &b = *it->second;
+		compared++;
+		string name = r.file + " " + r.backend + " " + r.stage;
+		if (r.median_mbps < b.median_mbps * (1 - tolerance)) {
+			regressions++;
+			err << "regression: " << name << " median " << r.median_mbps << " MB/s, baseline "
+			    << b.median_mbps << " MB/s (" << (r.median_mbps / b.median_mbps - 1) * 100 << "%)" << endl;
+		}
+		if (r.peak_bytes > b.peak_bytes * (1 + tolerance)) {
+			regressions++;
+			err << "regression: " << name << " peak memory " << r.peak_bytes << " bytes, baseline "
+			    << b.peak_bytes << " bytes (+" << ((double)r.peak_bytes / b.peak_bytes - 1) * 100 << "%)" << endl;
+		}
+	}
+	err << compared << " stages compared against baseline, " << regressions << " regressions" << endl;
+	return regressions;
+}
+
+//// USER INTERFACE ///////////////////////////////////////////////////////////
+
+void printUsage(const char *cmd) {
+	cerr << "usage: " << cmd << " [RUNS] [BACKENDS] [THREADS] [PERF] [OUTPUT] [BASELINE] [TOLERANCE] FILE..." << endl;
+	cerr << "\tcompresses and decompresses each FILE in-process with the tunneled compressors, and" << endl;
+	cerr << "\treports median and 95th percentile throughput (MB/s, relative to the size of FILE)" << endl;
+	cerr << "\tas well as peak memory of each stage recorded by the compressor in json" << endl;
+	cerr << "\tRUNS: -r N to compress and decompress each FILE N times (default 5)" << endl;
+	cerr << "\tBACKENDS: -s X[,Y...] second stages to be measured, identified by the suffix" << endl;
+	cerr << "\t          of their tunneled compressor, out of";
+	for (auto b : BACKENDS)	cerr << " " << b;
+	cerr << " (default all)" << endl;
+	cerr << "\tTHREADS: -t N to use up to N threads for a block (default 1)" << endl;
+	cerr << "\tPERF: -p to report median hardware events of each stage (cycles, instructions," << endl;
+	cerr << "\t      LLC misses, dTLB misses, branch misses), null if events are not available" << endl;
+	cerr << "\tOUTPUT: -o FILE to write json to FILE instead of standard output" << endl;
+	cerr << "\tBASELINE: -b FILE to compare results against json in FILE. Slower medians or" << endl;
+	cerr << "\t          higher peak memory are reported as regressions, and exit status is 2" << endl;
+	cerr << "\tTOLERANCE: -T P to report regressions only beyond P percent (default 10)" << endl;
+	cerr << "\tFILE: files to be measured, only the first " << t_max_size << " bytes are used" << endl;
+}
+
+int main( int argc, char **argv ) {
+	//analyse args
+	unsigned runs = 5;
+	unsigned threads = 1;
+	vector<string> backends( begin(BACKENDS), end(BACKENDS) );
+	string outfile, basefile;
+	double tolerance = 0.1;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "-t") == 0) { //number of runs / threads
+			int v = (i+1 < argc) ? atoi(argv[i+1]) : 0;
+			if (v <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid number for option " << argv[i] << "!" << endl;
+				return 1;
+			}
+			(argv[i][1] == 'r' ? runs : threads) = v;
+			i++;
+		}
+		else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) { //backends
+			backends.clear();
+			stringstream list( argv[++i] );
+			string b;
+			while (getline(list, b, ',')) {
+				if (find(begin(BACKENDS), end(BACKENDS), b) == end(BACKENDS)) {
+					printUsage(argv[0]);
+					cerr << "Unknown backend " << b << endl;
+					return 1;
+				}
+				backends.push_back( b );
+			}
+		}
+		else if (strcmp(argv[i], "-p") == 0) { //hardware events
+			countEvents = true;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) { //output file
+			outfile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) { //baseline
+			basefile = argv[++i];
+		}
+		else if (strcmp(argv[i], "-T") == 0 && i+1 < argc) { //tolerance
+			tolerance = atof(argv[++i]) / 100;
+			if (tolerance < 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid tolerance!" << endl;
+				return 1;
+			}
+		}
+		else {
+			printUsage(argv[0]);
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+	if (i >= argc || backends.empty()) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	vector<stage_result> results;
+	try {
+		//read baseline first, such that errors are detected before measuring
+		vector<stage_result> baseline;
+		if (!basefile.empty()) {
+			ifstream bin{ basefile };
+			if (!bin) {
+				throw invalid_argument("unable to open baseline \"" + basefile + "\"");
+			}
+			baseline = readJson( bin );
+		}
+
+		for (; i < argc; i++) {
+			string file = argv[i];
+			ifstream fin{ file, ifstream::binary };
+			if (!fin) {
+				throw invalid_argument("unable to open file \"" + file + "\"");
+			}
+			fin.seekg( 0, ifstream::end );
+			t_string_t T( min<uint64_t>( fin.tellg(), t_max_size ) );
+			fin.seekg( 0 );
+			fin.read( (char *)T.data(), T.size() );
+			if (T.empty()) {
+				cerr << "skipping empty file " << file << endl;
+				continue;
+			}
+
+			for (auto &backend : backends) {
+				cerr << "measuring " << file << " with " << backend << endl;
+				vector<stage_stats> stats;
+				if (!benchBackend( backend, T, runs, threads, stats )) {
+					throw invalid_argument("unknown backend " + backend);
+				}
+				string skipped; //stages not run in every run, e.g. if the file is incompressible
+				for (unsigned s = 0; s < STAGES; s++) {
+					if (stats[s].seconds.size() < runs) {
+						skipped += string(skipped.empty() ? "" : ", ") + STAGE_NAMES[s];
+						continue;
+					}
+					results.push_back( summarize( file, backend, STAGE_NAMES[s], T.size(), stats[s] ) );
+				}
+				if (!skipped.empty()) {
+					cerr << "skipping stages not run in every run: " << skipped << endl;
+				}
+			}
+		}
+
+		if (outfile.empty()) {
+			writeJson( results, runs, cout );
+		} else {
+			ofstream fout{ outfile, ofstream::out | ofstream::trunc };
+			if (!fout) {
+				throw invalid_argument("unable to open file \"" + outfile + "\"");
+			}
+			writeJson( results, runs, fout );
+		}
+
+		if (!basefile.empty() && compareBaseline( results, baseline, tolerance, cerr ) > 0) {
+			return 2;
+		}
+	} catch ( invalid_argument &e ) {
+		printUsage( argv[0] );
+		cerr << "Invalid argument: " << e.what() << endl;
+		return 1;
+	} catch ( runtime_error &e ) {
+		cerr << "Runtime error: " << e.what() << endl;
+		return 1;
+	} catch ( exception &e ) {
+		cerr << "Exception: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
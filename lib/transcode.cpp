@@ -0,0 +1,152 @@
+/*
+ * transcode.cpp for bwt tunneling
+ * Copyright (c) 2017 Uwe Baier All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string>
+#include <string.h>
+
+#include "bcm-compressor.hpp"
+#include "bw94-compressor.hpp"
+#include "huf-compressor.hpp"
+#include "wt-compressor.hpp"
+
+using namespace std;
+
+//known compressors, identified by their file suffix
+const char *SUFFIXES[] = { ".bwz", ".tbwz", ".bcm", ".tbcm", ".wt", ".twt", ".huf", ".thuf" };
+
+//returns the compressor of a file suffix, or an empty pointer if suffix is unknown
+unique_ptr<block_compressor> makeCompressor(const string &suffix) {
+	if (suffix == ".bwz")  return unique_ptr<block_compressor>( new bwt_compressor_bw94() );
+	if (suffix == ".tbwz") return unique_ptr<block_compressor>( new tbwt_compressor_bw94() );
+	if (suffix == ".bcm")  return unique_ptr<block_compressor>( new bwt_compressor_bcm() );
+	if (suffix == ".tbcm") return unique_ptr<block_compressor>( new tbwt_compressor_bcm() );
+	if (suffix == ".wt")   return unique_ptr<block_compressor>( new bwt_compressor_wt() );
+	if (suffix == ".twt")  return unique_ptr<block_compressor>( new tbwt_compressor_wt() );
+	if (suffix == ".huf")  return unique_ptr<block_compressor>( new bwt_compressor_huf() );
+	if (suffix == ".thuf") return unique_ptr<block_compressor>( new tbwt_compressor_huf() );
+	return unique_ptr<block_compressor>();
+}
+
+void printUsage(const char *cmd) {
+	cerr << "usage: " << cmd << " [INFO] [THREADS] FROM TO INFILE [OUTFILE]" << endl;
+	cerr << "\tINFO: -i for extra information about transcoding, nothing otherwise" << endl;
+	cerr << "\tTHREADS: -t N to use up to N threads per block (default 1)" << endl;
+	cerr << "\tFROM: suffix of the compressor of INFILE, one of";
+	for (auto s : SUFFIXES)	cerr << " " << s;
+	cerr << endl;
+	cerr << "\tTO: suffix of the compressor of OUTFILE (same choices as FROM)." << endl;
+	cerr << "\t    if FROM and TO share their transformation (both tunneled or both" << endl;
+	cerr << "\t    not tunneled), only the second stage of each block is recoded" << endl;
+	cerr << "\tINFILE: file to be transcoded" << endl;
+	cerr << "\tOUTFILE: path to resulting file (default: INFILE with suffix TO" << endl;
+	cerr << "\t         instead of FROM)" << endl;
+}
+
+int main( int argc, char **argv ) {
+	//analyse args
+	bool quiet = true;
+	unsigned threads = 1;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-i") == 0) { //information mode
+			quiet = false;
+		}
+		else if (strcmp(argv[i], "-t") == 0) { //number of threads
+			int t = (i+1 < argc) ? atoi(argv[++i]) : 0;
+			if (t <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid number of threads!" << endl;
+				return 1;
+			}
+			threads = t;
+		}
+		else {
+			printUsage(argv[0]);
+			cerr << "Unknown option " << argv[i] << endl;
+			return 1;
+		}
+	}
+	if (argc - i < 3 || argc - i > 4) {
+		printUsage(argv[0]);
+		return 1;
+	}
+	string fromsuffix = argv[i++];
+	string tosuffix = argv[i++];
+	string infile = argv[i++];
+	string outfile = (i < argc) ? argv[i] : "";
+	auto from = makeCompressor( fromsuffix );
+	auto to = makeCompressor( tosuffix );
+	if (!from || !to) {
+		printUsage(argv[0]);
+		cerr << "Unknown compressor suffix!" << endl;
+		return 1;
+	}
+	if (outfile.empty()) {
+		outfile = infile;
+		if (outfile.size() > fromsuffix.size() &&
+		    outfile.compare( outfile.size()-fromsuffix.size(), fromsuffix.size(), fromsuffix ) == 0) {
+			outfile.resize( outfile.size()-fromsuffix.size() );
+		}
+		outfile += tosuffix;
+	}
+
+	//open streams for infile and outfile
+	ifstream fin{ infile };
+	if (!fin) {
+		printUsage(argv[0]);
+		cerr << "unable to open file \"" << infile << "\"" << endl;
+		return 1;
+	}
+	ofstream fout{ outfile, ofstream::out | ofstream::trunc };
+	if (!fout) {
+		printUsage(argv[0]);
+		cerr << "unable to open file \"" << outfile << "\"" << endl;
+		return 1;
+	}
+
+	//transcode
+	from->set_quiet(quiet);
+	from->set_threads(threads);
+	to->set_quiet(quiet);
+	to->set_threads(threads);
+	try {
+		to->transcode( fin, fout, *from );
+	} catch ( invalid_argument &e ) {
+		printUsage( argv[0] );
+		cerr << "Invalid argument: " << e.what() << endl;
+		return 1;
+	} catch ( runtime_error &e ) {
+		printUsage( argv[0] );
+		cerr << "Runtime error: " << e.what() << endl;
+		return 1;
+	} catch ( exception &e ) {
+		cerr << "Exception: " << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -21,11 +21,23 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <dirent.h>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
 
 #if defined BW94
 	#include "bw94-compressor.hpp"
@@ -51,30 +63,298 @@
 	#include "wt-compressor.hpp"
 	#define FILESUFFIX ".twt"
 	#define COMPRESSOR tbwt_compressor_wt
+#elif defined HUF
+	#include "huf-compressor.hpp"
+	#define FILESUFFIX ".huf"
+	#define COMPRESSOR bwt_compressor_huf
+#elif defined THUF
+	#include "huf-compressor.hpp"
+	#define FILESUFFIX ".thuf"
+	#define COMPRESSOR tbwt_compressor_huf
+#elif defined MULTI
+	#include "bcm-compressor.hpp"
+	#include "bw94-compressor.hpp"
+	#include "huf-compressor.hpp"
+	#include "multi-compressor.hpp"
+	#include "wt-compressor.hpp"
+	#define FILESUFFIX ".mz"
+	#define COMPRESSOR multi_compressor
 #else
 	#error unknown block compressor
 #endif
+#include "solid-archive.hpp"
 
 using namespace std;
 
 const int MODE_COMPRESS = 0;
 const int MODE_DECOMPRESS = 1;
+const int MODE_APPEND = 2;
 
 void printUsage(const char *cmd) {
-	cerr << "usage: " << cmd << " MODE [INFO] INFILE [OUTFILE]" << endl;
-	cerr << "\tMODE: -c (compress) or -d (decompress)" << endl;
-	cerr << "\tINFO: -i for extra information about compression, nothing otherwise" << endl;
+	cerr << "usage: " << cmd << " MODE [INFO] [PERF] [THREADS] [BLOCKSIZE] [MEMORY] [EXTERNAL] [DEDUP] [CHECKSUM]"
+#ifdef MULTI
+	     << " [METHOD]"
+#endif
+	     << " [RANGE] INFILE [OUTFILE]" << endl;
+	cerr << "       " << cmd << " MODE BATCH [OPTIONS] INPUT..." << endl;
+	cerr << "       " << cmd << " -c SOLID [OPTIONS] INPUT... ARCHIVE" << endl;
+	cerr << "       " << cmd << " -d SOLID [OPTIONS] ARCHIVE [NAME]" << endl;
+	cerr << "\tMODE: -c (compress), -d (decompress) or -a (append INFILE compressed to the" << endl;
+	cerr << "\t      end of the compressed OUTFILE, without decompressing it, an empty or" << endl;
+	cerr << "\t      missing OUTFILE is created as a fresh compressed file)" << endl;
+	cerr << "\tINFO: -i for extra information about compression, or -j FILE to write" << endl;
+	cerr << "\t      metrics of each block and stage as json lines to FILE, nothing otherwise" << endl;
+	cerr << "\tPERF: -p to additionally count hardware events of each stage (cycles," << endl;
+	cerr << "\t      instructions, LLC misses, dTLB misses, branch misses) for -i or -j" << endl;
+	cerr << "\tTHREADS: -t N to use up to N threads per block (default 1)," << endl;
+	cerr << "\t         with multiple blocks, reading, bwt construction and encoding" << endl;
+	cerr << "\t         of different blocks additionally overlap" << endl;
+	cerr << "\tBLOCKSIZE: -b N to compress blocks of at most N bytes, N may end with" << endl;
+	cerr << "\t           K, M or G (default and maximum: 1536M)" << endl;
+	cerr << "\tMEMORY: -m P[,N] memory policy for big arrays, P is std (standard pages)," << endl;
+	cerr << "\t        thp (transparent huge pages, default) or huge (explicit huge pages)," << endl;
+	cerr << "\t        N is interleave (across NUMA nodes) or bindX (to NUMA node X)" << endl;
+	cerr << "\tEXTERNAL: -e N[,DIR] to construct the bwt of a block semi-externally, if" << endl;
+	cerr << "\t          text and suffix array need more than N bytes (N may end with" << endl;
+	cerr << "\t          K, M or G), temporary files are stored in DIR (default /tmp)." << endl;
+	cerr << "\t          In decompress mode, tunneled bwts of at most 16 characters are" << endl;
+	cerr << "\t          inverted packed (slower) if they need more than N bytes otherwise" << endl;
+	cerr << "\tDEDUP: -l to remove long repeats (at least 256 bytes) of each block" << endl;
+	cerr << "\t       before compression, nothing otherwise" << endl;
+	cerr << "\tCHECKSUM: -s to store a CRC32C checksum of each block, which is verified" << endl;
+	cerr << "\t          during decompression, nothing otherwise" << endl;
+#ifdef MULTI
+	cerr << "\tMETHOD: -M X[,T] method to compress blocks, X is bwz, tbwz, bcm, tbcm," << endl;
+	cerr << "\t        wt, twt, huf, thuf or auto (default). auto chooses the cheapest" << endl;
+	cerr << "\t        method for each block whose trial encoding of a sample is at most" << endl;
+	cerr << "\t        T times (default 1.02) the smallest trial encoding" << endl;
+#endif
+	cerr << "\tRANGE: -r OFFSET:LEN in decompress mode to decompress only LEN bytes at" << endl;
+	cerr << "\t       OFFSET of the text (both may end with K, M or G), decoding just the" << endl;
+	cerr << "\t       blocks covering them" << endl;
 	cerr << "\tINFILE: if compress mode, file to be compressed" << endl;
 	cerr << "\t        if decompress mode, file to be decompressed" << endl;
-	cerr << "\tOUTFILE: if compress mode, path to resulting compressed file" << endl;
+	cerr << "\tOUTFILE: if compress or append mode, path to resulting compressed file" << endl;
 	cerr << "\t         if decompress mode, path to file to be decompressed" << endl;
+	cerr << "\t         (default INFILE with suffix " FILESUFFIX " appended or removed)" << endl;
+	cerr << "\tBATCH: -B N to process all files of INPUT... in one process, N files at once" << endl;
+	cerr << "\t       (largest first), output files are named as without OUTFILE. OPTIONS" << endl;
+	cerr << "\t       are the options above, each INPUT is a file, a directory (all files" << endl;
+	cerr << "\t       below, in decompress mode only files with suffix " FILESUFFIX ")," << endl;
+	cerr << "\t       or @LIST to read inputs from file LIST, one per line" << endl;
+	cerr << "\tSOLID: -S to compress all files of INPUT... (see BATCH) together into ARCHIVE," << endl;
+	cerr << "\t       such that small files share blocks, or to extract all files of ARCHIVE" << endl;
+	cerr << "\t       (or file NAME only, decompressing just the blocks covering it) to their" << endl;
+	cerr << "\t       names, relative to the current directory" << endl;
+}
+
+//parses a size N[K|M|G] in bytes, returns 0 if the size is invalid
+long long parseSize(const string &s) {
+	char *unit = NULL;
+	long long size = strtoll(s.c_str(), &unit, 10);
+	if (unit != NULL && *unit != '\0') {
+		switch (*(unit++)) {
+			case 'G': size <<= 10; //fall through
+			case 'M': size <<= 10; //fall through
+			case 'K': size <<= 10; break;
+			default:  size = 0;
+		}
+		if (*unit != '\0')	size = 0;
+	}
+	return size;
+}
+
+//returns whether name ends with FILESUFFIX
+bool hasSuffix(const string &name) {
+	const string suffix = FILESUFFIX;
+	return name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+//returns the path of the output file of infile, if no output file is given
+string outputName(const string &infile, int mode) {
+	if (mode != MODE_DECOMPRESS)	return infile + FILESUFFIX;
+	return hasSuffix(infile) ? infile.substr(0, infile.size() - strlen(FILESUFFIX)) : infile + ".out";
+}
+
+//a file processed in batch mode
+struct batch_file {
+	string path;
+	string name; //path relative to the input given on the command line (see collectFiles)
+	uint64_t size;
+};
+
+//returns the last component of path, ignoring trailing slashes
+string baseName(const string &path) {
+	size_t end = path.find_last_not_of('/');
+	if (end == string::npos)	return "";
+	size_t start = path.rfind('/', end);
+	start = (start == string::npos) ? 0 : start + 1;
+	return path.substr(start, end + 1 - start);
+}
+
+//adds the files of input (a file, a directory or @LIST) to files. Files below directories
+// are added if they have suffix FILESUFFIX exactly in decompress mode. Files are named
+// relative to the directory of the input they are found by, i.e. by inputname (the last
+// component of input) followed by their path below input. Throws a runtime error naming
+// the path (e.g. an entry of a list) which is not accessible
+void collectFiles(const string &input, int mode, vector<batch_file> &files, const string &inputname) {
+	if (input[0] == '@') {
+		ifstream list{ input.substr(1) };
+		if (!list)	throw runtime_error("unable to read \"" + input.substr(1) + "\"");
+		string line;
+		while (getline(list, line)) {
+			if (!line.empty())	collectFiles(line, mode, files, baseName(line));
+		}
+		if (list.bad())	throw runtime_error("unable to read \"" + input.substr(1) + "\"");
+		return;
+	}
+	struct stat st;
+	if (stat(input.c_str(), &st) != 0)	throw runtime_error("unable to read \"" + input + "\"");
+	if (!S_ISDIR(st.st_mode)) {
+		files.push_back( batch_file{ input, inputname, (uint64_t)st.st_size } );
+		return;
+	}
+	DIR *dir = opendir(input.c_str());
+	if (dir == NULL)	throw runtime_error("unable to read \"" + input + "\"");
+	try {
+		for (struct dirent *e; (e = readdir(dir)) != NULL; ) {
+			string name = e->d_name;
+			if (name == "." || name == "..")	continue;
+			string path = input + "/" + name;
+			if (stat(path.c_str(), &st) != 0)	throw runtime_error("unable to read \"" + path + "\"");
+			if (S_ISDIR(st.st_mode)) {
+				collectFiles(path, mode, files, inputname + "/" + name);
+			} else if (S_ISREG(st.st_mode) && hasSuffix(name) == (mode == MODE_DECOMPRESS)) {
+				files.push_back( batch_file{ path, inputname + "/" + name, (uint64_t)st.st_size } );
+			}
+		}
+	} catch (...) {
+		closedir(dir);
+		throw;
+	}
+	closedir(dir);
+}
+
+//compresses or decompresses files using workers threads, which share compressor.
+// Compressions reuse its memory (decompressions allocate their buffers per file).
+// Largest files are processed first. Prints aggregate throughput and
+// returns the number of files which failed
+size_t processBatch(const block_compressor &compressor, int mode, vector<batch_file> &files,
+                    unsigned workers) {
+	sort(files.begin(), files.end(), [](const batch_file &a, const batch_file &b) {
+		return a.size > b.size;
+	});
+	block_compressor::compression_context ctx;
+	atomic<size_t> next{ 0 }, failed{ 0 };
+	atomic<uint64_t> insize{ 0 }, outsize{ 0 };
+	mutex err_mutex;
+
+	auto start = chrono::high_resolution_clock::now();
+	auto work = [&]() {
+		for (size_t f; (f = next++) < files.size(); ) {
+			const string &infile = files[f].path;
+			string outfile = outputName(infile, mode);
+			bool created = false; //whether outfile was created, such that it is removed on failure
+			try {
+				ifstream fin{ infile };
+				if (!fin)	throw runtime_error("unable to open file \"" + infile + "\"");
+				ofstream fout{ outfile, ofstream::out | ofstream::trunc };
+				if (!fout)	throw runtime_error("unable to open file \"" + outfile + "\"");
+				created = true;
+				if (mode == MODE_COMPRESS) {
+					compressor.compress( fin, fout, &ctx );
+				} else {
+					compressor.decompress( fin, fout );
+				}
+				uint64_t written = fout.tellp();
+				fout.close();
+				if (!fout)	throw runtime_error("unable to write file \"" + outfile + "\"");
+				insize += files[f].size;
+				outsize += written;
+			} catch ( exception &e ) {
+				if (created)	remove( outfile.c_str() ); //do not leave partial output behind
+				lock_guard<mutex> lock( err_mutex );
+				cerr << infile << ": " << e.what() << endl;
+				failed++;
+			}
+		}
+	};
+	vector<thread> pool;
+	for (size_t w = 1; w < min<size_t>(workers, files.size()); w++) {
+		pool.emplace_back( work );
+	}
+	work();
+	for (auto &t : pool)	t.join();
+	auto stop = chrono::high_resolution_clock::now();
+
+	//throughput is measured in bytes of text, i.e. of the decoded files in decompress mode
+	double sec = chrono::duration_cast<chrono::duration<double>>(stop - start).count();
+	uint64_t textsize = (mode == MODE_COMPRESS) ? insize : outsize;
+	cout << fixed << setprecision(3) << files.size() - failed << " of " << files.size()
+	     << " files processed, " << insize << " bytes read, " << outsize << " bytes written in "
+	     << sec << " s (" << textsize / (1024.0 * 1024.0) / max(sec, 1e-9) << " MB/s)" << endl;
+	return failed;
+}
+
+//returns the path a file of a solid archive is extracted to, i.e. its name without
+// leading slashes. Throws a runtime error if the name leaves the current directory
+string extractPath(const string &name) {
+	string path = name.substr( min( name.find_first_not_of('/'), name.size() ) );
+	string dotdot = "/" + path + "/";
+	if (path.empty() || dotdot.find("/../") != string::npos) {
+		throw runtime_error("unsafe file name \"" + name + "\" in archive");
+	}
+	return path;
+}
+
+//extracts file member (or all files if member is empty) of the solid archive in
+void extractArchive(const block_compressor &compressor, istream &in, const string &member) {
+	solid_archive archive( compressor );
+	archive.open( in );
+	auto open = [](const solid_archive::entry &e) {
+		string path = extractPath( e.name );
+		for (size_t p = path.find('/'); p != string::npos; p = path.find('/', p+1)) {
+			mkdir( path.substr(0, p).c_str(), 0777 ); //failures are detected when opening path
+		}
+		unique_ptr<ostream> out( new ofstream( path, ofstream::out | ofstream::trunc ) );
+		if (!*out)	throw runtime_error("unable to open file \"" + path + "\"");
+		out->exceptions( ostream::badbit );
+		return out;
+	};
+	if (member.empty()) {
+		archive.extract_all( in, open );
+		return;
+	}
+	auto e = archive.find( member );
+	if (e == nullptr) {
+		throw invalid_argument("no file \"" + member + "\" in archive");
+	}
+	archive.extract( in, *e, *open( *e ) );
 }
 
 int main( int argc, char **argv ) {
 	//analyse args
 	string infile;
 	string outfile;
+	vector<string> inputs;
+	unsigned workers = 0; //number of files processed at once in batch mode, 0 if not batch mode
+	bool solid = false;
+	string member; //file extracted from a solid archive (all if empty)
 	bool quiet = true;
+	string metricsfile;
+	bool perf = false;
+	bool dedup = false;
+	bool checksums = false;
+	long long rangeoffset = -1; //start of the decompressed range, -1 if the whole text is decompressed
+	long long rangelength = 0;
+	long long budget = 0;
+	string scratchdir = "/tmp";
+#ifdef MULTI
+	string method = multi_compressor::AUTO;
+	double target = 1.02;
+#endif
+	unsigned threads = 1;
+	long long blocksize = 0;
 	int mode = -1;
 
 	for (int i = 1; i < argc-1; i++) {
@@ -94,15 +374,127 @@ int main( int argc, char **argv ) {
 			}
 			mode = MODE_DECOMPRESS;
 		}
+		else if (strcmp(argv[i], "-a") == 0) { //append mode
+			if (mode != -1) {
+				printUsage(argv[0]);
+				cerr << "Mode defined already!" << endl;
+				return 1;
+			}
+			mode = MODE_APPEND;
+		}
 		else if (strcmp(argv[i], "-i") == 0) { //information mode
 			quiet = false;
 		}
-		else {
-			if (!infile.empty()) {
-				printUsage( argv[0] );
+		else if (strcmp(argv[i], "-j") == 0) { //metrics as json lines
+			metricsfile = (i+1 < argc-1) ? argv[++i] : "";
+			if (metricsfile.empty()) {
+				printUsage(argv[0]);
+				cerr << "Missing metrics file!" << endl;
 				return 1;
 			}
-			infile = argv[i];
+		}
+#ifdef MULTI
+		else if (strcmp(argv[i], "-M") == 0) { //method
+			method = (i+1 < argc-1) ? argv[++i] : "";
+			if (method.find(',') != string::npos) {
+				char *end = NULL;
+				target = strtod( method.c_str()+method.find(',')+1, &end );
+				if (*end != '\0' || !(target >= 1.0))	method = "";
+				method = method.substr( 0, method.find(',') );
+				if (method != multi_compressor::AUTO)	method = "";
+			}
+		}
+#endif
+		else if (strcmp(argv[i], "-e") == 0) { //semi-external construction
+			string arg = (i+1 < argc-1) ? argv[++i] : "";
+			budget = parseSize( arg.substr( 0, arg.find(',') ) );
+			if (arg.find(',') != string::npos)	scratchdir = arg.substr( arg.find(',')+1 );
+			if (budget <= 0 || scratchdir.empty()) {
+				printUsage(argv[0]);
+				cerr << "Invalid memory budget or scratch directory!" << endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-p") == 0) { //hardware event counters
+			perf = true;
+		}
+		else if (strcmp(argv[i], "-r") == 0) { //range of the text to be decompressed
+			string range = (i+1 < argc-1) ? argv[++i] : "";
+			string offset = range.substr( 0, range.find(':') );
+			rangeoffset = (offset == "0") ? 0 : parseSize( offset );
+			rangelength = (range.find(':') != string::npos) ? parseSize( range.substr( range.find(':')+1 ) ) : 0;
+			if ((rangeoffset <= 0 && offset != "0") || rangelength <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid range!" << endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "-l") == 0) { //long range deduplication
+			dedup = true;
+		}
+		else if (strcmp(argv[i], "-s") == 0) { //block checksums
+			checksums = true;
+		}
+		else if (strcmp(argv[i], "-B") == 0) { //batch mode
+			int w = (i+1 < argc-1) ? atoi(argv[++i]) : 0;
+			if (w <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid number of files processed at once!" << endl;
+				return 1;
+			}
+			workers = w;
+		}
+		else if (strcmp(argv[i], "-S") == 0) { //solid archive
+			solid = true;
+		}
+		else if (strcmp(argv[i], "-t") == 0) { //number of threads
+			int t = (i+1 < argc-1) ? atoi(argv[++i]) : 0;
+			if (t <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid number of threads!" << endl;
+				return 1;
+			}
+			threads = t;
+		}
+		else if (strcmp(argv[i], "-m") == 0) { //memory policy
+			string policy = (i+1 < argc-1) ? argv[++i] : "";
+			string pages = policy.substr( 0, policy.find(',') );
+			string numa = (policy.find(',') != string::npos) ? policy.substr( policy.find(',')+1 ) : "";
+			memory_policy::pages_t p = memory_policy::TRANSPARENT_HUGE_PAGES;
+			memory_policy::numa_t m = memory_policy::NUMA_DEFAULT;
+			int node = 0;
+			bool valid = true;
+			if      (pages == "std")  p = memory_policy::STANDARD_PAGES;
+			else if (pages == "thp")  p = memory_policy::TRANSPARENT_HUGE_PAGES;
+			else if (pages == "huge") p = memory_policy::EXPLICIT_HUGE_PAGES;
+			else valid = false;
+			if (numa == "interleave") {
+				m = memory_policy::NUMA_INTERLEAVE;
+			} else if (numa.compare( 0, 4, "bind" ) == 0 && numa.size() > 4) {
+				char *end = NULL;
+				node = strtol( numa.c_str()+4, &end, 10 );
+				m = memory_policy::NUMA_BIND;
+				valid = valid && *end == '\0' && node >= 0 && node < 64;
+			} else if (!numa.empty()) {
+				valid = false;
+			}
+			if (!valid) {
+				printUsage(argv[0]);
+				cerr << "Invalid memory policy!" << endl;
+				return 1;
+			}
+			memory_policy::set( p, m, node );
+		}
+		else if (strcmp(argv[i], "-b") == 0) { //block size
+			blocksize = (i+1 < argc-1) ? parseSize(argv[++i]) : 0;
+			if (blocksize <= 0) {
+				printUsage(argv[0]);
+				cerr << "Invalid block size!" << endl;
+				return 1;
+			}
+		}
+		else {
+			inputs.push_back( argv[i] );
 		}
 	}
 	if (mode == -1) {
@@ -110,38 +502,156 @@ int main( int argc, char **argv ) {
 		cerr << "Missing mode!" << endl;
 		return 1;
 	}
-	if (infile.empty()) { //check if outfile is defined
-		infile = argv[argc-1];
-		outfile = (mode == MODE_COMPRESS)
-		        ? infile + FILESUFFIX
-		        : infile.substr(0, infile.find_last_of(FILESUFFIX));
-	} else {
-		outfile = argv[argc-1];
+	if (workers > 0 && solid) {
+		printUsage(argv[0]);
+		cerr << "Batch mode and solid archives exclude each other!" << endl;
+		return 1;
 	}
-
-	//open streams for infile and outfile
-	ifstream fin{ infile };
-	ofstream fout{ outfile, ofstream::out | ofstream::trunc };
-	if (!fin) {
+	if (mode == MODE_APPEND && (workers > 0 || solid)) {
 		printUsage(argv[0]);
-		cerr << "unable to open file \"" << infile << "\"" << endl;
+		cerr << "Appending works on single files only!" << endl;
 		return 1;
-	} else if (!fout) {
+	}
+	if (rangeoffset >= 0 && (mode != MODE_DECOMPRESS || workers > 0 || solid)) {
 		printUsage(argv[0]);
-		cerr << "unable to open file \"" << outfile << "\"" << endl;
+		cerr << "Ranges can be decompressed from single files only!" << endl;
 		return 1;
 	}
+	if (workers > 0) { //all arguments are inputs
+		inputs.push_back( argv[argc-1] );
+	} else if (solid && mode == MODE_COMPRESS) { //inputs followed by the archive
+		if (inputs.empty()) {
+			printUsage( argv[0] );
+			return 1;
+		}
+		outfile = argv[argc-1];
+	} else if (solid) { //archive, optionally followed by the file to be extracted
+		if (inputs.size() > 1) {
+			printUsage( argv[0] );
+			return 1;
+		}
+		infile = inputs.empty() ? argv[argc-1] : inputs[0];
+		member = inputs.empty() ? "" : argv[argc-1];
+	} else if (inputs.size() > 1) {
+		printUsage( argv[0] );
+		return 1;
+	} else if (inputs.empty()) { //check if outfile is defined
+		infile = argv[argc-1];
+		outfile = outputName( infile, mode );
+	} else {
+		infile = inputs[0];
+		outfile = argv[argc-1];
+	}
+
+	//collect files of batch mode or solid archives, and open streams for infile and outfile
+	vector<batch_file> files;
+	ifstream fin;
+	ofstream fout;
+	fstream farchive;
+	if (workers > 0 || (solid && mode == MODE_COMPRESS)) {
+		try {
+			for (auto &in : inputs)
+				collectFiles( in, mode, files, baseName(in) );
+		} catch ( runtime_error &e ) {
+			printUsage(argv[0]);
+			cerr << e.what() << endl;
+			return 1;
+		}
+	}
+	if (!infile.empty()) {
+		fin.open( infile );
+		if (!fin) {
+			printUsage(argv[0]);
+			cerr << "unable to open file \"" << infile << "\"" << endl;
+			return 1;
+		}
+	}
+	if (!outfile.empty() && mode == MODE_APPEND) {
+		farchive.open( outfile, fstream::in | fstream::out );
+		if (!farchive) { //create a missing archive, appending to it compresses infile
+			farchive.clear();
+			farchive.open( outfile, fstream::in | fstream::out | fstream::trunc );
+		}
+		if (!farchive) {
+			printUsage(argv[0]);
+			cerr << "unable to open file \"" << outfile << "\"" << endl;
+			return 1;
+		}
+	} else if (!outfile.empty()) {
+		fout.open( outfile, ofstream::out | ofstream::trunc );
+		if (!fout) {
+			printUsage(argv[0]);
+			cerr << "unable to open file \"" << outfile << "\"" << endl;
+			return 1;
+		}
+	}
 
 	//compress or decompress, depending on mode
 	COMPRESSOR compressor;
+#ifdef MULTI
+	//costs are relative times to compress and decompress a byte, measured on text
+	compressor.add_method<bwt_compressor_bw94>( 0, "bwz", 1.1 );
+	compressor.add_method<tbwt_compressor_bw94>( 1, "tbwz", 2.5 );
+	compressor.add_method<bwt_compressor_bcm>( 2, "bcm", 1.9 );
+	compressor.add_method<tbwt_compressor_bcm>( 3, "tbcm", 2.4 );
+	compressor.add_method<bwt_compressor_wt>( 4, "wt", 1.8 );
+	compressor.add_method<tbwt_compressor_wt>( 5, "twt", 2.6 );
+	compressor.add_method<bwt_compressor_huf>( 6, "huf", 1.0 );
+	compressor.add_method<tbwt_compressor_huf>( 7, "thuf", 2.2 );
+	if (method != multi_compressor::AUTO && !compressor.has_method( method )) {
+		printUsage(argv[0]);
+		cerr << "Invalid method!" << endl;
+		return 1;
+	}
+	compressor.set_method( method );
+	compressor.set_target( target );
+#endif
 	compressor.set_quiet(quiet);
+	ofstream fmetrics;
+	if (!metricsfile.empty()) {
+		fmetrics.open( metricsfile, ofstream::out | ofstream::trunc );
+		if (!fmetrics) {
+			printUsage(argv[0]);
+			cerr << "unable to open file \"" << metricsfile << "\"" << endl;
+			return 1;
+		}
+		compressor.set_metrics_sink( make_shared<json_metrics_sink>( fmetrics ) );
+	}
+	compressor.set_perf_counters(perf);
+	compressor.set_threads(threads);
+	compressor.set_dedup(dedup);
+	compressor.set_checksums(checksums);
+	compressor.set_memory_budget(budget);
+	compressor.set_scratch_dir(scratchdir);
+	if (blocksize > 0) {
+		compressor.set_block_size( min( (streamsize)blocksize, compressor.get_max_block_size() ) );
+	}
+	if (workers > 0) {
+		return (processBatch( compressor, mode, files, workers ) > 0) ? 1 : 0;
+	}
 	try {
-		switch (mode) {
+		if (solid && mode == MODE_COMPRESS) {
+			vector<string> paths, names;
+			for (auto &f : files) {
+				paths.push_back( f.path );
+				names.push_back( f.name );
+			}
+			solid_archive( compressor ).create( paths, names, fout );
+		} else if (solid) {
+			extractArchive( compressor, fin, member );
+		} else switch (mode) {
 		case MODE_COMPRESS:
 			compressor.compress( fin, fout );
 			break;
 		case MODE_DECOMPRESS:
-			compressor.decompress( fin, fout );
+			if (rangeoffset >= 0) {
+				compressor.decompress_range( fin, rangeoffset, rangelength, fout );
+			} else {
+				compressor.decompress( fin, fout );
+			}
+			break;
+		case MODE_APPEND:
+			compressor.append( fin, farchive );
 			break;
 		default:
 			throw logic_error("Internal fault");